@@ -0,0 +1,913 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Dumps read from archives without extracting them
+ *
+ * A tar is read as a stream of 512 byte blocks, so it can be decompressed on
+ * the fly; the members of other sizes than the filter accepts are skipped,
+ * without reading them when the tar is not compressed. A zip is read by its
+ * central directory, the sizes of the members are known before any member
+ * is decompressed.
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "archive.h"
+#ifdef HAVE_ZLIB
+#   include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#   include <zstd.h>
+#endif
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+#define TAR_BLOCK           512u
+/* compressed input read at once */
+#define STREAM_BUFFER       (64u * 1024u)
+/* longest member name kept */
+#define MEMBER_NAME_MAX     4096u
+/* end of central directory record of zip without the comment */
+#define ZIP_EOCD_SIZE       22u
+#define ZIP_COMMENT_MAX     65535u
+#define ZIP_CENTRAL_SIZE    46u
+#define ZIP_LOCAL_SIZE      30u
+
+/* compression of a stream */
+#define COMP_NONE           0
+#define COMP_GZIP           1
+#define COMP_DEFLATE        2   /* raw deflate of a zip member */
+#define COMP_ZSTD           3
+
+/**************************************************************************//**
+ *                              PRIVATE TYPES
+ *****************************************************************************/
+/* decompressed bytes of a file */
+struct stream
+{
+    FILE *fp;
+    int compression;
+    uint64_t remaining;         /* compressed bytes left to be read */
+    unsigned char *in;
+    size_t in_len;
+    size_t in_pos;
+    bool end;                   /* no more decompressed bytes */
+    bool failed;
+#ifdef HAVE_ZLIB
+    z_stream z;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zs;
+#endif
+};
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Reads a little endian 16 bit number.
+ *****************************************************************************/
+static unsigned read_le16(const unsigned char *p)
+{
+    return (unsigned)p[0] | ((unsigned)p[1] << 8);
+}
+
+/**************************************************************************//**
+ * Reads a little endian 32 bit number.
+ *****************************************************************************/
+static uint32_t read_le32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+/**************************************************************************//**
+ * Opens the stream of the file decompressed by the method. Returns -1 if the
+ * method has not been built in.
+ *****************************************************************************/
+static int stream_open(struct stream *s, FILE *fp, int compression,
+                       uint64_t remaining)
+{
+    memset(s, 0, sizeof(*s));
+    s->fp = fp;
+    s->compression = compression;
+    s->remaining = remaining;
+
+    if(compression == COMP_NONE)
+    {
+        return 0;
+    }
+
+    s->in = malloc(STREAM_BUFFER);
+    if(s->in == NULL)
+    {
+        return -1;
+    }
+
+    switch(compression)
+    {
+#ifdef HAVE_ZLIB
+    case COMP_GZIP:
+    case COMP_DEFLATE:
+        /* 16 selects the gzip header, the negative window raw deflate */
+        if(inflateInit2(&s->z, (compression == COMP_GZIP) ? 15 + 16 : -15) == Z_OK)
+        {
+            return 0;
+        }
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case COMP_ZSTD:
+        s->zs = ZSTD_createDStream();
+        if((s->zs != NULL) && !ZSTD_isError(ZSTD_initDStream(s->zs)))
+        {
+            return 0;
+        }
+        ZSTD_freeDStream(s->zs);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    free(s->in);
+    s->in = NULL;
+
+    return -1;
+}
+
+/**************************************************************************//**
+ * Releases the decompressor of the stream, the file is kept open.
+ *****************************************************************************/
+static void stream_close(struct stream *s)
+{
+#ifdef HAVE_ZLIB
+    if((s->compression == COMP_GZIP) || (s->compression == COMP_DEFLATE))
+    {
+        inflateEnd(&s->z);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if(s->compression == COMP_ZSTD)
+    {
+        ZSTD_freeDStream(s->zs);
+    }
+#endif
+    free(s->in);
+}
+
+/**************************************************************************//**
+ * Refills the buffer of the compressed input. Returns false at the end of
+ * the input.
+ *****************************************************************************/
+static bool stream_fill(struct stream *s)
+{
+    size_t size = STREAM_BUFFER;
+
+    if(s->in_pos < s->in_len)
+    {
+        return true;
+    }
+    if(size > s->remaining)
+    {
+        size = (size_t)s->remaining;
+    }
+    s->in_len = (size > 0) ? fread(s->in, 1, size, s->fp) : 0;
+    s->in_pos = 0;
+    s->remaining -= s->in_len;
+    if(ferror(s->fp))
+    {
+        s->failed = true;
+    }
+
+    return s->in_len > 0;
+}
+
+/**************************************************************************//**
+ * Reads up to len decompressed bytes. Returns the number of bytes read, less
+ * than len at the end of the stream or on a failure, which sets failed.
+ *****************************************************************************/
+static size_t stream_read(struct stream *s, unsigned char *buf, size_t len)
+{
+    size_t done = 0;
+
+    if(s->compression == COMP_NONE)
+    {
+        if(len > s->remaining)
+        {
+            len = (size_t)s->remaining;
+        }
+        done = fread(buf, 1, len, s->fp);
+        s->remaining -= done;
+        s->failed = s->failed || ferror(s->fp);
+        return done;
+    }
+
+    while((done < len) && !s->end && !s->failed)
+    {
+        bool more = stream_fill(s);
+
+#ifdef HAVE_ZLIB
+        if((s->compression == COMP_GZIP) || (s->compression == COMP_DEFLATE))
+        {
+            int r;
+
+            s->z.next_in = &s->in[s->in_pos];
+            s->z.avail_in = (uInt)(s->in_len - s->in_pos);
+            s->z.next_out = &buf[done];
+            s->z.avail_out = (uInt)(len - done);
+            r = inflate(&s->z, Z_NO_FLUSH);
+            done = len - s->z.avail_out;
+            s->in_pos = s->in_len - s->z.avail_in;
+
+            if(r == Z_STREAM_END)
+            {
+                /* gzip files may be concatenated */
+                if((s->compression == COMP_GZIP) && stream_fill(s))
+                {
+                    inflateReset(&s->z);
+                }
+                else
+                {
+                    s->end = true;
+                }
+            }
+            else if(((r != Z_OK) && (r != Z_BUF_ERROR)) ||
+                    (!more && (done < len)))
+            {
+                /* broken or truncated data */
+                s->failed = true;
+            }
+        }
+#endif
+#ifdef HAVE_ZSTD
+        if(s->compression == COMP_ZSTD)
+        {
+            ZSTD_inBuffer in = { s->in, s->in_len, s->in_pos };
+            ZSTD_outBuffer out = { buf, len, done };
+            size_t r = ZSTD_decompressStream(s->zs, &out, &in);
+
+            done = out.pos;
+            s->in_pos = in.pos;
+            if(ZSTD_isError(r))
+            {
+                s->failed = true;
+            }
+            else if(!more && (done < len))
+            {
+                /* a finished frame at the end of the input is the end of
+                   the stream, anything else is truncated */
+                s->end = true;
+                s->failed = (r != 0);
+            }
+        }
+#endif
+        if(!more && (done < len) && !s->end)
+        {
+            s->failed = true;
+        }
+    }
+
+    return done;
+}
+
+/**************************************************************************//**
+ * Skips len decompressed bytes, seeking over them when not compressed.
+ * Returns -1 if the stream ends before.
+ *****************************************************************************/
+static int stream_skip(struct stream *s, uint64_t len)
+{
+    unsigned char buf[4096];
+
+    if((s->compression == COMP_NONE) && (len > 0))
+    {
+        if(fseeko(s->fp, (off_t)len, SEEK_CUR) != 0)
+        {
+            s->failed = true;
+            return -1;
+        }
+        return 0;
+    }
+
+    while(len > 0)
+    {
+        size_t n = (len > sizeof(buf)) ? sizeof(buf) : (size_t)len;
+
+        if(stream_read(s, buf, n) != n)
+        {
+            return -1;
+        }
+        len -= n;
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Checks whether the block is a tar header.
+ *****************************************************************************/
+static bool is_tar(const unsigned char *h, size_t len)
+{
+    return (len >= 262u) && (memcmp(&h[257], "ustar", 5) == 0);
+}
+
+/**************************************************************************//**
+ * Parses a number of the tar header, octal or base-256 for big ones.
+ *****************************************************************************/
+static uint64_t tar_number(const unsigned char *p, unsigned len)
+{
+    uint64_t n = 0;
+    unsigned i;
+
+    if(p[0] & 0x80u)
+    {
+        for(i = 1; i < len; i++)
+        {
+            n = (n << 8) | p[i];
+        }
+        return n;
+    }
+
+    for(i = 0; (i < len) && (p[i] == ' '); i++)
+    {
+    }
+    for(; (i < len) && (p[i] >= '0') && (p[i] <= '7'); i++)
+    {
+        n = (n << 3) | (uint64_t)(p[i] - '0');
+    }
+
+    return n;
+}
+
+/**************************************************************************//**
+ * Checks the checksum of the tar header, the sum of its bytes with the
+ * checksum field taken as spaces.
+ *****************************************************************************/
+static bool tar_checksum_ok(const unsigned char *h)
+{
+    uint64_t sum = 0;
+    unsigned i;
+
+    for(i = 0; i < TAR_BLOCK; i++)
+    {
+        sum += ((i >= 148u) && (i < 156u)) ? (unsigned)' ' : h[i];
+    }
+
+    return sum == tar_number(&h[148], 8);
+}
+
+/**************************************************************************//**
+ * Takes the path from the records of a pax extended header. Every record is
+ * "LENGTH KEY=VALUE\n", the length includes itself and the newline.
+ *****************************************************************************/
+static void pax_path(const char *records, size_t len, char *name)
+{
+    size_t pos = 0;
+
+    while(pos < len)
+    {
+        char *end;
+        unsigned long record = strtoul(&records[pos], &end, 10);
+        const char *key = end + 1;
+        size_t value_len;
+
+        if((record == 0) || (*end != ' ') || (record > len - pos) ||
+           (records[pos + record - 1u] != '\n'))
+        {
+            return;
+        }
+        /* the key and the newline must fit to the record */
+        if(((size_t)(key - &records[pos]) + 5u < record) &&
+           (strncmp(key, "path=", 5) == 0))
+        {
+            value_len = (size_t)(&records[pos + record - 1u] - (key + 5));
+            if(value_len > MEMBER_NAME_MAX)
+            {
+                value_len = MEMBER_NAME_MAX;
+            }
+            memcpy(name, key + 5, value_len);
+            name[value_len] = '\0';
+        }
+        pos += record;
+    }
+}
+
+/**************************************************************************//**
+ * Reads the members of the tar stream. The first header may have been read
+ * already to detect the tar. Returns -1 if the tar is broken.
+ *****************************************************************************/
+static int read_tar(struct stream *s, const char *path,
+                    const unsigned char *first, size_t limit,
+                    archive_filter filter, archive_member member, void *ctx,
+                    struct output *err, unsigned *failed)
+{
+    unsigned char h[TAR_BLOCK];
+    char long_name[MEMBER_NAME_MAX + 1u];
+    char name[2u * MEMBER_NAME_MAX + 2u];
+    unsigned char *data;
+    unsigned long skipped = 0;
+    bool have_long_name = false;
+    int r = 0;
+
+    data = malloc(limit ? limit : 1u);
+    if(data == NULL)
+    {
+        out_printf(err, "Out of memory\n");
+        return -1;
+    }
+
+    for(;;)
+    {
+        uint64_t size, padded;
+        unsigned type;
+        size_t n;
+
+        if(first != NULL)
+        {
+            memcpy(h, first, TAR_BLOCK);
+            first = NULL;
+        }
+        else
+        {
+            n = stream_read(s, h, TAR_BLOCK);
+            if((n == 0) && !s->failed)
+            {
+                /* the end blocks are missing, that is tolerated */
+                break;
+            }
+            if(n != TAR_BLOCK)
+            {
+                r = -1;
+                break;
+            }
+        }
+
+        if((h[0] == 0) && (tar_number(&h[148], 8) == 0))
+        {
+            /* the end of the archive */
+            break;
+        }
+        if(!tar_checksum_ok(h))
+        {
+            r = -1;
+            break;
+        }
+
+        size = tar_number(&h[124], 12);
+        padded = (size + TAR_BLOCK - 1u) & ~(uint64_t)(TAR_BLOCK - 1u);
+        type = h[156];
+
+        if((type == 'L') || (type == 'x'))
+        {
+            /* GNU long name or pax extended header of the next member */
+            char records[MEMBER_NAME_MAX + 64u];
+            size_t take = (size < sizeof(records)) ? (size_t)size
+                                                    : sizeof(records) - 1u;
+
+            if((stream_read(s, (unsigned char *)records, take) != take) ||
+               (stream_skip(s, padded - take) != 0))
+            {
+                r = -1;
+                break;
+            }
+            records[take] = '\0';
+            if(type == 'L')
+            {
+                size_t len = (take > MEMBER_NAME_MAX) ? MEMBER_NAME_MAX : take;
+
+                memcpy(long_name, records, len);
+                long_name[len] = '\0';
+                have_long_name = true;
+            }
+            else
+            {
+                long_name[0] = '\0';
+                pax_path(records, take, long_name);
+                have_long_name = (long_name[0] != '\0');
+            }
+            continue;
+        }
+
+        if(((type != '0') && (type != '\0') && (type != '7')) || !filter(size))
+        {
+            if((type == '0') || (type == '\0') || (type == '7'))
+            {
+                skipped++;
+            }
+            have_long_name = false;
+            if(stream_skip(s, padded) != 0)
+            {
+                r = -1;
+                break;
+            }
+            continue;
+        }
+
+        if(have_long_name)
+        {
+            snprintf(name, sizeof(name), "%s:%s", path, long_name);
+        }
+        else if(h[345] != 0)
+        {
+            /* ustar splits long names to a prefix and a name */
+            snprintf(name, sizeof(name), "%s:%.155s/%.100s", path,
+                     (const char *)&h[345], (const char *)&h[0]);
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "%s:%.100s", path, (const char *)&h[0]);
+        }
+        have_long_name = false;
+
+        n = (size < limit) ? (size_t)size : limit;
+        if((stream_read(s, data, n) != n) || (stream_skip(s, padded - n) != 0))
+        {
+            r = -1;
+            break;
+        }
+        if(member(ctx, name, data, n) != 0)
+        {
+            (*failed)++;
+        }
+    }
+
+    if(r != 0)
+    {
+        out_printf(err, "Broken or truncated tar archive %s\n", path);
+    }
+    if(skipped > 0)
+    {
+        out_printf(err, "%s: %lu members of other sizes skipped\n", path,
+                   skipped);
+    }
+    free(data);
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Loads the central directory of the zip file. Returns -1 if there is none,
+ * zip64 is not supported.
+ *****************************************************************************/
+static int zip_directory(FILE *fp, unsigned char **dir, uint32_t *dir_size,
+                         unsigned *entries)
+{
+    unsigned char *tail;
+    const unsigned char *eocd = NULL;
+    off_t file_size;
+    size_t tail_size, i;
+    uint32_t offset = 0;
+
+    *dir = NULL;
+    if((fseeko(fp, 0, SEEK_END) != 0) || ((file_size = ftello(fp)) < 0) ||
+       ((uint64_t)file_size < ZIP_EOCD_SIZE))
+    {
+        return -1;
+    }
+    tail_size = ((uint64_t)file_size < ZIP_EOCD_SIZE + ZIP_COMMENT_MAX)
+                ? (size_t)file_size : ZIP_EOCD_SIZE + ZIP_COMMENT_MAX;
+    tail = malloc(tail_size);
+    if((tail == NULL) ||
+       (fseeko(fp, file_size - (off_t)tail_size, SEEK_SET) != 0) ||
+       (fread(tail, 1, tail_size, fp) != tail_size))
+    {
+        free(tail);
+        return -1;
+    }
+
+    /* the end of central directory record is followed just by the comment */
+    for(i = tail_size - ZIP_EOCD_SIZE + 1u; i-- > 0;)
+    {
+        if(memcmp(&tail[i], "PK\5\6", 4) == 0)
+        {
+            eocd = &tail[i];
+            break;
+        }
+    }
+    if(eocd != NULL)
+    {
+        *entries = read_le16(&eocd[10]);
+        *dir_size = read_le32(&eocd[12]);
+        offset = read_le32(&eocd[16]);
+        if((*entries != 0xffffu) && (offset != UINT32_MAX) &&
+           ((uint64_t)offset + *dir_size <= (uint64_t)file_size))
+        {
+            *dir = malloc(*dir_size ? *dir_size : 1u);
+        }
+    }
+    free(tail);
+
+    if((*dir == NULL) || (fseeko(fp, (off_t)offset, SEEK_SET) != 0) ||
+       (fread(*dir, 1, *dir_size, fp) != *dir_size))
+    {
+        free(*dir);
+        *dir = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Reads n bytes of the zip member of the central directory entry. Returns 1
+ * if the compression method is not supported, -1 if the zip is broken.
+ *****************************************************************************/
+static int zip_member(FILE *fp, const unsigned char *entry, unsigned char *data,
+                      size_t n)
+{
+    unsigned char local[ZIP_LOCAL_SIZE];
+    unsigned method = read_le16(&entry[10]);
+    struct stream s;
+    size_t got;
+
+    if((fseeko(fp, (off_t)read_le32(&entry[42]), SEEK_SET) != 0) ||
+       (fread(local, 1, sizeof(local), fp) != sizeof(local)) ||
+       (memcmp(local, "PK\3\4", 4) != 0) ||
+       (fseeko(fp, (off_t)(read_le16(&local[26]) + read_le16(&local[28])),
+               SEEK_CUR) != 0))
+    {
+        return -1;
+    }
+
+    if(method == 0)
+    {
+        return (fread(data, 1, n, fp) == n) ? 0 : -1;
+    }
+    if((method != 8) ||
+       (stream_open(&s, fp, COMP_DEFLATE, read_le32(&entry[20])) != 0))
+    {
+        return 1;
+    }
+    got = stream_read(&s, data, n);
+    stream_close(&s);
+
+    return (got == n) ? 0 : -1;
+}
+
+/**************************************************************************//**
+ * Reads the members of the zip file listed by its central directory. The
+ * members are stored or compressed by deflate. Returns -1 if the zip is
+ * broken.
+ *****************************************************************************/
+static int read_zip(FILE *fp, const char *path, size_t limit,
+                    archive_filter filter, archive_member member, void *ctx,
+                    struct output *err, unsigned *failed)
+{
+    unsigned char *dir;
+    unsigned char *data;
+    char name[2u * MEMBER_NAME_MAX + 2u];
+    uint32_t dir_size;
+    unsigned entries, entry;
+    size_t pos = 0;
+    unsigned long skipped = 0;
+    int r = 0;
+
+    if(zip_directory(fp, &dir, &dir_size, &entries) != 0)
+    {
+        out_printf(err, "Broken or unsupported zip archive %s\n", path);
+        return -1;
+    }
+    data = malloc(limit ? limit : 1u);
+    if(data == NULL)
+    {
+        free(dir);
+        out_printf(err, "Out of memory\n");
+        return -1;
+    }
+
+    for(entry = 0; (r == 0) && (entry < entries); entry++)
+    {
+        const unsigned char *e = &dir[pos];
+        unsigned name_len;
+        uint32_t size;
+        size_t n;
+
+        if((pos + ZIP_CENTRAL_SIZE > dir_size) ||
+           (memcmp(e, "PK\1\2", 4) != 0))
+        {
+            r = -1;
+            break;
+        }
+        size = read_le32(&e[24]);
+        name_len = read_le16(&e[28]);
+        pos += ZIP_CENTRAL_SIZE + name_len + read_le16(&e[30]) +
+               read_le16(&e[32]);
+        if(pos > dir_size)
+        {
+            r = -1;
+            break;
+        }
+
+        if((name_len > 0) && (e[ZIP_CENTRAL_SIZE + name_len - 1u] == '/'))
+        {
+            /* a directory */
+            continue;
+        }
+        if(!filter(size))
+        {
+            skipped++;
+            continue;
+        }
+        snprintf(name, sizeof(name), "%s:%.*s", path,
+                 (int)((name_len > MEMBER_NAME_MAX) ? MEMBER_NAME_MAX : name_len),
+                 (const char *)&e[ZIP_CENTRAL_SIZE]);
+
+        n = (size < limit) ? (size_t)size : limit;
+        r = zip_member(fp, e, data, n);
+        if(r > 0)
+        {
+            out_printf(err, "%s: compression method %u is not supported\n",
+                       name, read_le16(&e[10]));
+            (*failed)++;
+            r = 0;
+        }
+        else if((r == 0) && (member(ctx, name, data, n) != 0))
+        {
+            (*failed)++;
+        }
+    }
+
+    if(r != 0)
+    {
+        out_printf(err, "Broken or unsupported zip archive %s\n", path);
+    }
+    if(skipped > 0)
+    {
+        out_printf(err, "%s: %lu members of other sizes skipped\n", path,
+                   skipped);
+    }
+    free(dir);
+    free(data);
+
+    return r;
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Tells the kind of the archive by the first bytes of the file, up to
+ * ARCHIVE_PROBE_SIZE of them.
+ *****************************************************************************/
+int archive_detect(const unsigned char *head, size_t len)
+{
+    if((len >= 4u) && ((memcmp(head, "PK\3\4", 4) == 0) ||
+                       (memcmp(head, "PK\5\6", 4) == 0)))
+    {
+        return ARCHIVE_ZIP;
+    }
+    /* deflate and no reserved flags, so the two bytes of the magic are not
+       enough for the UID of a pack of dumps to be taken for gzip */
+    if((len >= 4u) && (head[0] == 0x1fu) && (head[1] == 0x8bu) &&
+       (head[2] == 8u) && ((head[3] & 0xe0u) == 0))
+    {
+        return ARCHIVE_GZIP;
+    }
+    if((len >= 4u) && (memcmp(head, "\x28\xb5\x2f\xfd", 4) == 0))
+    {
+        return ARCHIVE_ZSTD;
+    }
+    if(is_tar(head, len))
+    {
+        return ARCHIVE_TAR;
+    }
+
+    return ARCHIVE_NONE;
+}
+
+/**************************************************************************//**
+ * Checks whether the name of the file is one of an archive, so it holds more
+ * dumps.
+ *****************************************************************************/
+bool archive_name(const char *path)
+{
+    static const char *const suffixes[] = {
+        ".tar", ".tgz", ".tar.gz", ".tzst", ".tar.zst", ".zip"
+    };
+    size_t len = strlen(path);
+    size_t i;
+
+    for(i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++)
+    {
+        size_t n = strlen(suffixes[i]);
+
+        if((len > n) && (strcmp(&path[len - n], suffixes[i]) == 0))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**************************************************************************//**
+ * Reads the archive of the kind from the opened file, named path in the
+ * names of the members and in the messages, like archive_read(). The file
+ * is left open.
+ *****************************************************************************/
+int archive_read_file(FILE *fp, const char *path, int kind, size_t limit,
+                      archive_filter filter, archive_member member, void *ctx,
+                      struct output *err, unsigned *failed)
+{
+    struct stream s;
+    unsigned char head[TAR_BLOCK];
+    unsigned char *data;
+    size_t n;
+    int r;
+
+    if(kind == ARCHIVE_ZIP)
+    {
+        return read_zip(fp, path, limit, filter, member, ctx, err, failed);
+    }
+
+    if(stream_open(&s, fp, (kind == ARCHIVE_GZIP) ? COMP_GZIP :
+                           (kind == ARCHIVE_ZSTD) ? COMP_ZSTD : COMP_NONE,
+                   UINT64_MAX) != 0)
+    {
+        out_printf(err, "%s: %s decompression is not built in\n", path,
+                   (kind == ARCHIVE_GZIP) ? "gzip" : "zstd");
+        return -1;
+    }
+
+    n = stream_read(&s, head, sizeof(head));
+    if((n == sizeof(head)) && is_tar(head, n))
+    {
+        r = read_tar(&s, path, head, limit, filter, member, ctx, err, failed);
+    }
+    else if((kind == ARCHIVE_TAR) || s.failed || (limit < n) ||
+            ((data = malloc(limit)) == NULL))
+    {
+        out_printf(err, "Broken archive %s\n", path);
+        r = -1;
+    }
+    else
+    {
+        /* a single compressed dump */
+        memcpy(data, head, n);
+        n += stream_read(&s, &data[n], limit - n);
+        r = s.failed ? -1 : 0;
+        if(r != 0)
+        {
+            out_printf(err, "Broken archive %s\n", path);
+        }
+        else if(member(ctx, path, data, n) != 0)
+        {
+            (*failed)++;
+        }
+        free(data);
+    }
+
+    stream_close(&s);
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Reads the archive of the kind and passes every member accepted by filter,
+ * up to limit bytes of it, to member. A file compressed by gzip or zstd
+ * which is not a tar is passed as a single dump. The members which have
+ * failed are counted in failed. Returns -1 if the archive cannot be read.
+ *****************************************************************************/
+int archive_read(const char *path, int kind, size_t limit,
+                 archive_filter filter, archive_member member, void *ctx,
+                 struct output *err, unsigned *failed)
+{
+    FILE *fp;
+    int r;
+
+    fp = fopen(path, "rb");
+    if(fp == NULL)
+    {
+        out_printf(err, "Error opening the input file %s: %s\n", path,
+                   strerror(errno));
+        return -1;
+    }
+    r = archive_read_file(fp, path, kind, limit, filter, member, ctx, err,
+                          failed);
+    fclose(fp);
+
+    return r;
+}
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Dumps read from archives without extracting them: tar, optionally
+ * compressed by gzip or zstd, zip, and single dumps compressed by gzip or
+ * zstd. The members are decompressed as a stream and passed from memory.
+ *****************************************************************************/
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "format.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* kinds of the archives told by archive_detect() */
+#define ARCHIVE_NONE        0
+#define ARCHIVE_TAR         1
+#define ARCHIVE_ZIP         2
+#define ARCHIVE_GZIP        3
+#define ARCHIVE_ZSTD        4
+
+/* bytes of the file needed by archive_detect() */
+#define ARCHIVE_PROBE_SIZE  512u
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* Checks whether a member of the size is to be read, the others are skipped
+   without being decompressed where the archive allows it. */
+typedef bool (*archive_filter)(uint64_t size);
+
+/* Gets one member of the archive, at most limit bytes of it. Returns non zero
+   if the member has failed. */
+typedef int (*archive_member)(void *ctx, const char *name,
+                              const unsigned char *data, size_t size);
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int archive_detect(const unsigned char *head, size_t len);
+bool archive_name(const char *path);
+int archive_read(const char *path, int kind, size_t limit,
+                 archive_filter filter, archive_member member, void *ctx,
+                 struct output *err, unsigned *failed);
+int archive_read_file(FILE *fp, const char *path, int kind, size_t limit,
+                      archive_filter filter, archive_member member, void *ctx,
+                      struct output *err, unsigned *failed);
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,367 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Audit of the keys used by dumps against a dictionary of known keys
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audit.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+#define KEY_SET_INITIAL     1024u
+
+/**************************************************************************//**
+ *                          PRIVATE VARIABLES
+ *****************************************************************************/
+/* what the known keys can do with the data blocks or the trailer, bit 0
+   read, bit 1 write */
+static const char *const access_names[4] = {
+    "locked", "read", "write", "read/write"
+};
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Orders the keys for qsort().
+ *****************************************************************************/
+static int compare_keys(const void *a, const void *b)
+{
+    uint64_t ka = *(const uint64_t *)a;
+    uint64_t kb = *(const uint64_t *)b;
+
+    return (ka > kb) - (ka < kb);
+}
+
+/**************************************************************************//**
+ * Returns the value of the hex digit or -1 for another character.
+ *****************************************************************************/
+static int hex_digit(char c)
+{
+    if((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    if((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+    if((c >= 'A') && (c <= 'F'))
+    {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/**************************************************************************//**
+ * Checks whether nothing but a comment follows on the line.
+ *****************************************************************************/
+static bool line_end(const char *text)
+{
+    while((*text == ' ') || (*text == '\t'))
+    {
+        text++;
+    }
+
+    return (*text == '\0') || (*text == '\n') || (*text == '\r') ||
+           (*text == '#');
+}
+
+/**************************************************************************//**
+ * Parses one line of the dictionary: a key of 12 hex digits, optionally
+ * followed by a comment. Returns 1 for a key, 0 for an empty line or a
+ * comment and -1 for anything else.
+ *****************************************************************************/
+static int parse_line(const char *text, uint64_t *key)
+{
+    unsigned i;
+
+    if(line_end(text))
+    {
+        return 0;
+    }
+    while((*text == ' ') || (*text == '\t'))
+    {
+        text++;
+    }
+
+    *key = 0;
+    for(i = 0; i < 12u; i++)
+    {
+        int digit = hex_digit(text[i]);
+
+        if(digit < 0)
+        {
+            return -1;
+        }
+        *key = (*key << 4) | (unsigned)digit;
+    }
+
+    return line_end(&text[12]) ? 1 : -1;
+}
+
+/**************************************************************************//**
+ * Returns the access to the data blocks of the sector granted by the keys
+ * found in the dictionary merged over the blocks: bit 0 for read, bit 1 for
+ * write. Blocks with invalid access bits grant nothing.
+ *****************************************************************************/
+static unsigned sector_access(const struct mfd_sector *si, unsigned sector,
+                              bool known_a, bool known_b)
+{
+    unsigned keys = (known_a ? (MFD_READ_A | MFD_WRITE_A) : 0) |
+                    (known_b ? (MFD_READ_B | MFD_WRITE_B) : 0);
+    unsigned access = 0;
+    unsigned block;
+
+    for(block = 0; block + 1u < si->blocks; block++)
+    {
+        int condition = mfd_block_condition(&si->ac, sector, block);
+
+        if(condition >= 0)
+        {
+            access |= mfd_data_access((unsigned)condition);
+        }
+    }
+    access &= keys;
+
+    return ((access & (MFD_READ_A | MFD_READ_B)) ? 1u : 0) |
+           ((access & (MFD_WRITE_A | MFD_WRITE_B)) ? 2u : 0);
+}
+
+/**************************************************************************//**
+ * Returns the access to the trailer of the sector granted by the keys found
+ * in the dictionary: bit 0 for the read of key B, bit 1 for rewriting the
+ * keys or the access bits, which takes the whole sector over. Invalid access
+ * bits grant nothing.
+ *****************************************************************************/
+static unsigned trailer_access(const struct mfd_sector *si, bool known_a,
+                               bool known_b)
+{
+    unsigned keys = (known_a ? (MFD_READ_A | MFD_WRITE_A) : 0) |
+                    (known_b ? (MFD_READ_B | MFD_WRITE_B) : 0);
+    unsigned access;
+
+    if(!(si->ac.valid & 0x08u))
+    {
+        return 0;
+    }
+    access = mfd_trailer_access(si->ac.cond[3]) & keys;
+
+    return ((access & (MFD_READ_A | MFD_READ_B)) ? 1u : 0) |
+           ((access & (MFD_WRITE_A | MFD_WRITE_B)) ? 2u : 0);
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Loads the dictionary file, one key of 12 hex digits per line. Empty lines
+ * and the rest of a line after # are skipped, whatever its length. Returns -1
+ * and sets errno on failure; a line which is not a key gives EINVAL and its
+ * number in line.
+ *****************************************************************************/
+int key_set_load(struct key_set *set, const char *path, unsigned long *line)
+{
+    FILE *fp;
+    char text[256];
+    size_t capacity = 0;
+    size_t i, n;
+
+    set->keys = NULL;
+    set->count = 0;
+    *line = 0;
+
+    fp = fopen(path, "r");
+    if(fp == NULL)
+    {
+        return -1;
+    }
+
+    while(fgets(text, sizeof(text), fp) != NULL)
+    {
+        uint64_t key;
+        bool long_line = (strchr(text, '\n') == NULL) && !feof(fp);
+        int r;
+
+        (*line)++;
+        r = parse_line(text, &key);
+        /* the rest of a line longer than the buffer may only be a comment,
+           it is skipped without being read as the next line */
+        if(long_line && (r >= 0) && (strchr(text, '#') == NULL))
+        {
+            r = -1;
+        }
+        if(long_line && (r >= 0))
+        {
+            int c;
+
+            do
+            {
+                c = fgetc(fp);
+            } while((c != EOF) && (c != '\n'));
+        }
+        if(r < 0)
+        {
+            fclose(fp);
+            key_set_free(set);
+            errno = EINVAL;
+            return -1;
+        }
+        if(r == 0)
+        {
+            continue;
+        }
+
+        if(set->count == capacity)
+        {
+            size_t bigger = capacity ? 2u * capacity : KEY_SET_INITIAL;
+            uint64_t *keys = realloc(set->keys, bigger * sizeof(uint64_t));
+
+            if(keys == NULL)
+            {
+                fclose(fp);
+                key_set_free(set);
+                errno = ENOMEM;
+                return -1;
+            }
+            set->keys = keys;
+            capacity = bigger;
+        }
+        set->keys[set->count++] = key;
+    }
+
+    if(ferror(fp))
+    {
+        fclose(fp);
+        key_set_free(set);
+        return -1;
+    }
+    fclose(fp);
+
+    /* dictionaries are merged from more sources, the duplicates are dropped */
+    if(set->count > 0)
+    {
+        qsort(set->keys, set->count, sizeof(uint64_t), compare_keys);
+        for(i = 1, n = 1; i < set->count; i++)
+        {
+            if(set->keys[i] != set->keys[n - 1u])
+            {
+                set->keys[n++] = set->keys[i];
+            }
+        }
+        set->count = n;
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Releases the keys of the dictionary.
+ *****************************************************************************/
+void key_set_free(struct key_set *set)
+{
+    free(set->keys);
+    set->keys = NULL;
+    set->count = 0;
+}
+
+/**************************************************************************//**
+ * Checks whether the key is in the dictionary. The binary search halves the
+ * range by a conditional move instead of a branch, so the lookups of random
+ * keys do not stall on mispredictions.
+ *****************************************************************************/
+bool key_set_contains(const struct key_set *set, uint64_t key)
+{
+    const uint64_t *base = set->keys;
+    size_t n = set->count;
+
+    if(n == 0)
+    {
+        return false;
+    }
+
+    while(n > 1u)
+    {
+        size_t half = n / 2u;
+
+        base = (base[half] <= key) ? &base[half] : base;
+        n -= half;
+    }
+
+    return *base == key;
+}
+
+/**************************************************************************//**
+ * Writes one line for every selected sector using a key of the dictionary,
+ * with the known keys and the access to the data blocks and to the trailer
+ * they grant. Dumps without such sectors write nothing. The number of the
+ * listed sectors is returned in at_risk. Returns -1 on out of memory.
+ *****************************************************************************/
+int audit_dump(const struct key_set *set, const char *name,
+               const struct mfd_dump *info, uint64_t sectors,
+               struct output *out, unsigned *at_risk)
+{
+    unsigned sector;
+
+    *at_risk = 0;
+    for(sector = 0; sector < info->sectors; sector++)
+    {
+        const struct mfd_sector *si = &info->sector[sector];
+        const uint8_t *trailer = &info->data[si->trailer];
+        uint64_t keyA = mfd_key48(&trailer[0]);
+        uint64_t keyB = mfd_key48(&trailer[10]);
+        bool known_a, known_b;
+        unsigned access, trailer_rights;
+
+        if(!((sectors >> sector) & 1u))
+        {
+            continue;
+        }
+
+        known_a = key_set_contains(set, keyA);
+        known_b = key_set_contains(set, keyB);
+        if(!known_a && !known_b)
+        {
+            continue;
+        }
+
+        access = sector_access(si, sector, known_a, known_b);
+        trailer_rights = trailer_access(si, known_a, known_b);
+        (*at_risk)++;
+        if((out_printf(out, "%s: sector %u", name, sector) < 0) ||
+           (known_a && (out_printf(out, " key A %012llx",
+                                   (unsigned long long)keyA) < 0)) ||
+           (known_b && (out_printf(out, " key B %012llx",
+                                   (unsigned long long)keyB) < 0)) ||
+           (out_printf(out, ": data %s, trailer %s\n", access_names[access],
+                       access_names[trailer_rights]) < 0))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Audit of the keys used by dumps against a dictionary of known keys, like
+ * the default and leaked keys collected by the tools cracking the cards.
+ * The dictionary is kept as a sorted array of 48 bit keys.
+ *****************************************************************************/
+#ifndef AUDIT_H
+#define AUDIT_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "format.h"
+#include "mfd.h"
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* distinct keys of the dictionary in ascending order */
+struct key_set
+{
+    uint64_t *keys;
+    size_t count;
+};
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int key_set_load(struct key_set *set, const char *path, unsigned long *line);
+void key_set_free(struct key_set *set);
+bool key_set_contains(const struct key_set *set, uint64_t key);
+
+int audit_dump(const struct key_set *set, const char *name,
+               const struct mfd_dump *info, uint64_t sectors,
+               struct output *out, unsigned *at_risk);
+
+#endif /* AUDIT_H */
@@ -0,0 +1,476 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Benchmarks of the decoder and of the renderers on synthetic corpora of all
+ * the card sizes. Every result is written as one JSON object per line:
+ *   {"bench":"...","size":1024,"items":...,"bytes":...,"seconds":...,
+ *    "mb_per_s":...,"items_per_s":...,"simd":"avx2"}
+ * items are dumps for the end to end benchmarks and calls for the others,
+ * simd is the instruction set of the kernels chosen for the CPU.
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "format.h"
+#include "import.h"
+#include "mfd.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* default size of the corpus of each card size */
+#define CORPUS_DEFAULT_MB   16u
+#define CORPUS_MAX_MB       4096u
+
+/**************************************************************************//**
+ *                              PRIVATE TYPES
+ *****************************************************************************/
+/* dumps of one size stored one after another */
+struct corpus
+{
+    unsigned char *data;
+    unsigned dump_size;
+    size_t dumps;
+};
+
+/**************************************************************************//**
+ *                          PRIVATE VARIABLES
+ *****************************************************************************/
+static const unsigned dump_sizes[] = { 320u, 1024u, 2048u, 4096u };
+
+/* access bits of typical trailers, the last one is invalid */
+static const unsigned char trailer_access[][4] =
+{
+    { 0xff, 0x07, 0x80, 0x69 },
+    { 0x78, 0x77, 0x88, 0x00 },
+    { 0x08, 0x77, 0x8f, 0x00 },
+    { 0x7f, 0x07, 0x88, 0x69 },
+    { 0xff, 0xff, 0xff, 0xff },
+};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+/* keeps the results alive, so the compiler cannot drop the measured work */
+static volatile unsigned long sink;
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Returns the next pseudo random number, xorshift64*.
+ *****************************************************************************/
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+/**************************************************************************//**
+ * Returns the monotonic time in seconds.
+ *****************************************************************************/
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**************************************************************************//**
+ * Fills the corpus by dumps of random data and keys. Every 4th sector is
+ * left untouched with the transport trailer, the access bits of the others
+ * are taken from trailer_access.
+ *****************************************************************************/
+static int make_corpus(struct corpus *c, unsigned dump_size, size_t bytes)
+{
+    size_t d;
+
+    c->dump_size = dump_size;
+    c->dumps = bytes / dump_size;
+    if(c->dumps == 0)
+    {
+        c->dumps = 1;
+    }
+    c->data = malloc(c->dumps * dump_size);
+    if(c->data == NULL)
+    {
+        return -1;
+    }
+
+    for(d = 0; d < c->dumps; d++)
+    {
+        unsigned char *dump = &c->data[d * dump_size];
+        struct mfd_dump info;
+        unsigned i, sector;
+
+        for(i = 0; i < dump_size; i += 8u)
+        {
+            uint64_t r = rng();
+
+            memcpy(&dump[i], &r, 8);
+        }
+        mfd_decode(dump, dump_size, &info);
+        for(sector = 0; sector < info.sectors; sector++)
+        {
+            const struct mfd_sector *si = &info.sector[sector];
+            unsigned char *trailer = &dump[si->trailer];
+
+            if((sector > 0) && ((rng() & 3u) == 0))
+            {
+                memset(&dump[si->start], 0, si->trailer - si->start);
+                memset(trailer, 0xff, 16);
+                memcpy(&trailer[6], trailer_access[0], 4);
+            }
+            else
+            {
+                memcpy(&trailer[6], trailer_access[rng() % 5u], 4);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Writes one result line.
+ *****************************************************************************/
+static void report(const char *bench, unsigned size, size_t items,
+                   size_t bytes, double seconds)
+{
+    if(seconds <= 0)
+    {
+        seconds = 1e-9;
+    }
+    printf("{\"bench\":\"%s\",\"size\":%u,\"items\":%lu,\"bytes\":%lu,"
+           "\"seconds\":%.6f,\"mb_per_s\":%.1f,\"items_per_s\":%.0f,"
+           "\"simd\":\"%s\"}\n",
+           bench, size, (unsigned long)items, (unsigned long)bytes, seconds,
+           (double)bytes / seconds / 1e6, (double)items / seconds,
+           mfd_simd_name(mfd_simd()));
+    fflush(stdout);
+}
+
+/**************************************************************************//**
+ * Times mfd_get_access_condition() for every block of every dump.
+ *****************************************************************************/
+static void bench_access_condition(const struct corpus *c)
+{
+    unsigned long sum = 0;
+    size_t calls = 0;
+    size_t d;
+    double t;
+
+    t = now();
+    for(d = 0; d < c->dumps; d++)
+    {
+        const unsigned char *dump = &c->data[d * c->dump_size];
+        struct mfd_dump info;
+        unsigned sector, block;
+
+        mfd_decode(dump, c->dump_size, &info);
+        for(sector = 0; sector < info.sectors; sector++)
+        {
+            const struct mfd_sector *si = &info.sector[sector];
+
+            for(block = 0; block < si->blocks; block++)
+            {
+                sum += (unsigned)mfd_get_access_condition(sector, block,
+                                                          &dump[si->trailer + 6u]);
+            }
+            calls += si->blocks;
+        }
+    }
+    t = now() - t;
+    sink = sum;
+
+    report("access_condition", c->dump_size, calls,
+           c->dumps * c->dump_size, t);
+}
+
+/**************************************************************************//**
+ * Times the hex and the ASCII rendering of all the blocks.
+ *****************************************************************************/
+static void bench_render_blocks(const struct corpus *c)
+{
+    char line[2u * MFD_BLOCK_SIZE];
+    size_t blocks = c->dumps * c->dump_size / MFD_BLOCK_SIZE;
+    size_t i;
+    double t;
+
+    t = now();
+    for(i = 0; i < blocks; i++)
+    {
+        render_hex(line, &c->data[i * MFD_BLOCK_SIZE], MFD_BLOCK_SIZE);
+        sink += (unsigned char)line[i % sizeof(line)];
+    }
+    t = now() - t;
+    report("render_hex", c->dump_size, blocks, blocks * MFD_BLOCK_SIZE, t);
+
+    t = now();
+    for(i = 0; i < blocks; i++)
+    {
+        render_ascii(line, &c->data[i * MFD_BLOCK_SIZE], MFD_BLOCK_SIZE);
+        sink += (unsigned char)line[i % MFD_BLOCK_SIZE];
+    }
+    t = now() - t;
+    report("render_ascii", c->dump_size, blocks, blocks * MFD_BLOCK_SIZE, t);
+}
+
+/**************************************************************************//**
+ * Times mfd_soa_match_key() looking up the default key among the keys A and
+ * B of all the dumps stored by mfd_decode_batch().
+ *****************************************************************************/
+static int bench_match_key(const struct corpus *c)
+{
+    struct mfd_soa soa;
+    const uint8_t **dumps = malloc(c->dumps * sizeof(*dumps));
+    size_t *sizes = malloc(c->dumps * sizeof(*sizes));
+    uint64_t *masks = malloc(c->dumps * sizeof(*masks));
+    size_t d;
+    double t;
+    int r = 0;
+
+    memset(&soa, 0, sizeof(soa));
+    soa.capacity = c->dumps;
+    soa.keysA = malloc(c->dumps * sizeof(*soa.keysA));
+    soa.keysB = malloc(c->dumps * sizeof(*soa.keysB));
+    soa.conditions = malloc(c->dumps * sizeof(*soa.conditions));
+    soa.valid = malloc(c->dumps * sizeof(*soa.valid));
+    soa.sectors = malloc(c->dumps * sizeof(*soa.sectors));
+    if((dumps == NULL) || (sizes == NULL) || (masks == NULL) ||
+       (soa.keysA == NULL) || (soa.keysB == NULL) ||
+       (soa.conditions == NULL) || (soa.valid == NULL) ||
+       (soa.sectors == NULL))
+    {
+        r = -1;
+    }
+    else
+    {
+        for(d = 0; d < c->dumps; d++)
+        {
+            dumps[d] = &c->data[d * c->dump_size];
+            sizes[d] = c->dump_size;
+        }
+        mfd_decode_batch(dumps, sizes, c->dumps, &soa);
+
+        t = now();
+        mfd_soa_match_key(&soa, MFD_KEY_A | MFD_KEY_B, 0xffffffffffffull,
+                          masks);
+        t = now() - t;
+        for(d = 0; d < c->dumps; d++)
+        {
+            sink += (unsigned long)masks[d];
+        }
+        report("soa_match_key", c->dump_size, c->dumps,
+               c->dumps * 2u * sizeof(*soa.keysA), t);
+    }
+
+    free(dumps);
+    free(sizes);
+    free(masks);
+    free(soa.keysA);
+    free(soa.keysB);
+    free(soa.conditions);
+    free(soa.valid);
+    free(soa.sectors);
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Times the conversion of the dumps saved as .eml hex text, one block per
+ * line, back to the binary layout.
+ *****************************************************************************/
+static int bench_import(const struct corpus *c)
+{
+    size_t line = 2u * MFD_BLOCK_SIZE + 1u;
+    size_t text_size = c->dump_size / MFD_BLOCK_SIZE * line;
+    unsigned char *text = malloc(c->dumps * text_size);
+    unsigned char dump[MFD_MAX_DUMP_SIZE];
+    size_t d, i;
+    double t;
+    int r = 0;
+
+    if(text == NULL)
+    {
+        return -1;
+    }
+    for(i = 0; i < c->dumps * c->dump_size / MFD_BLOCK_SIZE; i++)
+    {
+        render_hex((char *)&text[i * line], &c->data[i * MFD_BLOCK_SIZE],
+                   MFD_BLOCK_SIZE);
+        text[i * line + line - 1u] = '\n';
+    }
+
+    t = now();
+    for(d = 0; (d < c->dumps) && (r == 0); d++)
+    {
+        size_t size;
+        unsigned long error_line;
+
+        r = import_parse(IMPORT_HEX, &text[d * text_size], text_size, dump,
+                         &size, &error_line);
+        sink += size;
+    }
+    t = now() - t;
+    free(text);
+
+    if(r == 0)
+    {
+        report("import_eml", c->dump_size, c->dumps, c->dumps * text_size, t);
+    }
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Times decoding and rendering of every dump in one output format. The
+ * output buffer is reused like in the batch mode of mfdread.
+ *****************************************************************************/
+static int bench_format(const struct corpus *c, const char *bench,
+                        const struct format_options *opt)
+{
+    struct output out = { NULL, 0, 0 };
+    size_t d;
+    double t;
+    int r = 0;
+
+    t = now();
+    for(d = 0; (d < c->dumps) && (r == 0); d++)
+    {
+        struct mfd_dump info;
+
+        out.len = 0;
+        if(mfd_decode(&c->data[d * c->dump_size], c->dump_size, &info) != MFD_OK)
+        {
+            r = -1;
+        }
+        else if(opt == NULL)
+        {
+            /* decoding only */
+            sink += info.access_errors;
+        }
+        else if(opt->format == FORMAT_TEXT)
+        {
+            r = opt->values_only ? render_values(&info, opt, &out)
+                                 : render_text(&info, opt, &out);
+        }
+        else if(opt->format == FORMAT_BINARY)
+        {
+            r = render_binary(&info, opt, &out);
+        }
+        else
+        {
+            r = render_json("bench.mfd", &info, opt, &out);
+        }
+        sink += out.len;
+    }
+    t = now() - t;
+    free(out.data);
+
+    if(r == 0)
+    {
+        report(bench, c->dump_size, c->dumps, c->dumps * c->dump_size, t);
+    }
+
+    return r;
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Runs all the benchmarks. The optional argument is the size of the corpus
+ * of each card size in MB.
+ *****************************************************************************/
+int main(int argc, char **argv)
+{
+    struct format_options text = { FORMAT_TEXT, false, false, false,
+                                   &palette_ansi,
+                                   FORMAT_ALL_SECTORS, FORMAT_ALL_BLOCKS };
+    struct format_options compact = { FORMAT_TEXT, true, false, false,
+                                      &palette_plain,
+                                      FORMAT_ALL_SECTORS, FORMAT_ALL_BLOCKS };
+    struct format_options values = { FORMAT_TEXT, false, true, false,
+                                     &palette_plain,
+                                     FORMAT_ALL_SECTORS, FORMAT_ALL_BLOCKS };
+    struct format_options json = { FORMAT_JSON, false, false, false,
+                                   &palette_plain,
+                                   FORMAT_ALL_SECTORS, FORMAT_ALL_BLOCKS };
+    struct format_options ndjson = { FORMAT_NDJSON, false, false, false,
+                                     &palette_plain,
+                                     FORMAT_ALL_SECTORS, FORMAT_ALL_BLOCKS };
+    struct format_options binary = { FORMAT_BINARY, false, false, false,
+                                     &palette_plain,
+                                     FORMAT_ALL_SECTORS, FORMAT_ALL_BLOCKS };
+    unsigned long mb = CORPUS_DEFAULT_MB;
+    unsigned i;
+
+    if(argc > 1)
+    {
+        mb = strtoul(argv[1], NULL, 0);
+        if((mb == 0) || (mb > CORPUS_MAX_MB))
+        {
+            fprintf(stderr, "Usage: %s [MB of each corpus, 1 to %u]\n",
+                    argv[0], CORPUS_MAX_MB);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for(i = 0; i < sizeof(dump_sizes) / sizeof(dump_sizes[0]); i++)
+    {
+        struct corpus c;
+
+        if(make_corpus(&c, dump_sizes[i], (size_t)mb * 1024u * 1024u) != 0)
+        {
+            fprintf(stderr, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+
+        bench_access_condition(&c);
+        bench_render_blocks(&c);
+        if((bench_format(&c, "decode", NULL) != 0) ||
+           (bench_format(&c, "text", &text) != 0) ||
+           (bench_format(&c, "text_compact", &compact) != 0) ||
+           (bench_format(&c, "values", &values) != 0) ||
+           (bench_format(&c, "json", &json) != 0) ||
+           (bench_format(&c, "ndjson", &ndjson) != 0) ||
+           (bench_format(&c, "binary", &binary) != 0) ||
+           (bench_import(&c) != 0) || (bench_match_key(&c) != 0))
+        {
+            fprintf(stderr, "Benchmark of %u byte dumps failed\n",
+                    dump_sizes[i]);
+            free(c.data);
+            return EXIT_FAILURE;
+        }
+        free(c.data);
+    }
+
+    return EXIT_SUCCESS;
+}
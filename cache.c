@@ -0,0 +1,451 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Cache of the rendered output of dumps
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "mfd.h"
+#include "replace.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+#define CACHE_BYTE_ORDER    0x01020304u
+#define CACHE_INITIAL       1024u
+/* longest text accepted from the cache file */
+#define CACHE_TEXT_MAX      (1024u * 1024u)
+/* most bytes of the dumps and the texts saved to the cache file */
+#define CACHE_SAVE_MAX      (256u * 1024u * 1024u)
+
+/**************************************************************************//**
+ *                              PRIVATE TYPES
+ *****************************************************************************/
+/* Layout of the cache file, in the byte order of the host which has written
+   it: the header, then every entry as a record followed by the dump and the
+   text. */
+struct cache_header
+{
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t reserved;
+    uint64_t count;
+};
+
+struct cache_record
+{
+    uint64_t hash;
+    uint32_t fingerprint;
+    uint32_t data_size;
+    uint32_t sectors;
+    uint32_t access_errors;
+    uint64_t text_len;
+};
+
+/**************************************************************************//**
+ *                          PRIVATE VARIABLES
+ *****************************************************************************/
+static const char cache_magic[8] = { 'M', 'F', 'D', 'C', 'A', 'C', 0, 1 };
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Returns the slot holding the dump rendered by the settings, or the empty
+ * slot where it would be stored. The table is never full.
+ *****************************************************************************/
+static size_t find_slot(const struct dump_cache *cache, uint64_t hash,
+                        uint32_t fingerprint, const unsigned char *data,
+                        unsigned data_size)
+{
+    size_t mask = cache->capacity - 1u;
+    size_t s = (size_t)((hash ^ (fingerprint * 0x9E3779B97F4A7C15ull)) >> 8)
+               & mask;
+
+    while(cache->slots[s].data != NULL)
+    {
+        const struct cache_entry *e = &cache->slots[s];
+
+        /* the hash only selects the candidates, the dump is compared too */
+        if((e->hash == hash) && (e->fingerprint == fingerprint) &&
+           (e->data_size == data_size) &&
+           (memcmp(e->data, data, data_size) == 0))
+        {
+            break;
+        }
+        s = (s + 1u) & mask;
+    }
+
+    return s;
+}
+
+/**************************************************************************//**
+ * Doubles the hash table when it is half full.
+ *****************************************************************************/
+static int grow_table(struct dump_cache *cache)
+{
+    struct dump_cache bigger = *cache;
+    size_t i;
+
+    if(cache->count + 1u <= cache->capacity / 2u)
+    {
+        return 0;
+    }
+
+    bigger.capacity = cache->capacity * 2u;
+    bigger.slots = calloc(bigger.capacity, sizeof(*bigger.slots));
+    if(bigger.slots == NULL)
+    {
+        return -1;
+    }
+    for(i = 0; i < cache->capacity; i++)
+    {
+        const struct cache_entry *e = &cache->slots[i];
+
+        if(e->data != NULL)
+        {
+            bigger.slots[find_slot(&bigger, e->hash, e->fingerprint, e->data,
+                                   e->data_size)] = *e;
+        }
+    }
+    free(cache->slots);
+    cache->slots = bigger.slots;
+    cache->capacity = bigger.capacity;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Adds the entry with a copy of the dump and of the text unless the table
+ * already has it. The lock must be held.
+ *****************************************************************************/
+static int insert(struct dump_cache *cache, const struct cache_entry *entry,
+                  const unsigned char *data, const char *text)
+{
+    struct cache_entry *e;
+    size_t s;
+
+    if(grow_table(cache) != 0)
+    {
+        return -1;
+    }
+    s = find_slot(cache, entry->hash, entry->fingerprint, data,
+                  entry->data_size);
+    e = &cache->slots[s];
+    if(e->data != NULL)
+    {
+        return 0;
+    }
+
+    *e = *entry;
+    e->data = malloc(entry->data_size + entry->text_len + 1u);
+    if(e->data == NULL)
+    {
+        return -1;
+    }
+    memcpy(e->data, data, entry->data_size);
+    memcpy(&e->data[entry->data_size], text, entry->text_len);
+    cache->count++;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Adds the entries used or not used by this run to the entries to be saved
+ * while they fit to CACHE_SAVE_MAX bytes.
+ *****************************************************************************/
+static size_t select_entries(const struct dump_cache *cache, bool used,
+                             const struct cache_entry **saved, size_t count,
+                             uint64_t *bytes)
+{
+    size_t i;
+
+    for(i = 0; i < cache->capacity; i++)
+    {
+        const struct cache_entry *e = &cache->slots[i];
+        uint64_t size;
+
+        if((e->data == NULL) || (e->used != used))
+        {
+            continue;
+        }
+        size = (uint64_t)e->data_size + e->text_len;
+        if(*bytes + size <= CACHE_SAVE_MAX)
+        {
+            *bytes += size;
+            saved[count++] = e;
+        }
+    }
+
+    return count;
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Prepares an empty cache.
+ *****************************************************************************/
+int cache_init(struct dump_cache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->capacity = CACHE_INITIAL;
+    cache->slots = calloc(cache->capacity, sizeof(*cache->slots));
+    if(cache->slots == NULL)
+    {
+        return -1;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Releases all the entries.
+ *****************************************************************************/
+void cache_free(struct dump_cache *cache)
+{
+    size_t i;
+
+    for(i = 0; i < cache->capacity; i++)
+    {
+        free(cache->slots[i].data);
+    }
+    free(cache->slots);
+    pthread_mutex_destroy(&cache->lock);
+    memset(cache, 0, sizeof(*cache));
+}
+
+/**************************************************************************//**
+ * Adds the entries of the cache file. A missing file is an empty cache and a
+ * truncated one gives the entries read whole, as a cache only saves work and
+ * a run interrupted while writing it must not fail the next one. Returns -1
+ * and sets errno on failure, EINVAL if the file is not a cache.
+ *****************************************************************************/
+int cache_load(struct dump_cache *cache, const char *path)
+{
+    struct cache_header h;
+    unsigned char *buffer = NULL;
+    uint64_t i;
+    FILE *fp;
+    int r = 0;
+
+    fp = fopen(path, "rb");
+    if(fp == NULL)
+    {
+        return (errno == ENOENT) ? 0 : -1;
+    }
+
+    if(fread(&h, sizeof(h), 1, fp) != 1)
+    {
+        fclose(fp);
+        return 0;
+    }
+    if((memcmp(h.magic, cache_magic, sizeof(cache_magic)) != 0) ||
+       (h.byte_order != CACHE_BYTE_ORDER))
+    {
+        fclose(fp);
+        errno = EINVAL;
+        return -1;
+    }
+    buffer = malloc(MFD_MAX_DUMP_SIZE + CACHE_TEXT_MAX);
+    if(buffer == NULL)
+    {
+        fclose(fp);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for(i = 0; (i < h.count) && (r == 0); i++)
+    {
+        struct cache_record rec;
+        struct cache_entry e;
+
+        if((fread(&rec, sizeof(rec), 1, fp) != 1) ||
+           (rec.data_size > MFD_MAX_DUMP_SIZE) ||
+           (rec.text_len > CACHE_TEXT_MAX) ||
+           (fread(buffer, 1, rec.data_size + rec.text_len, fp) !=
+            rec.data_size + rec.text_len))
+        {
+            /* the rest of a truncated or damaged file is dropped */
+            break;
+        }
+        e.hash = rec.hash;
+        e.fingerprint = rec.fingerprint;
+        e.data_size = rec.data_size;
+        e.sectors = rec.sectors;
+        e.access_errors = rec.access_errors;
+        e.text_len = (size_t)rec.text_len;
+        e.data = NULL;
+        e.used = false;
+        if(insert(cache, &e, buffer, (const char *)&buffer[rec.data_size]) != 0)
+        {
+            errno = ENOMEM;
+            r = -1;
+        }
+    }
+
+    free(buffer);
+    fclose(fp);
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Writes the entries to the cache file, at most CACHE_SAVE_MAX bytes of the
+ * dumps and the texts. The entries used by this run are kept first, those
+ * not used are dropped when the file would grow bigger. Returns -1 and sets
+ * errno on failure.
+ *****************************************************************************/
+int cache_save(struct dump_cache *cache, const char *path)
+{
+    struct cache_header h;
+    const struct cache_entry **saved;
+    uint64_t bytes = 0;
+    size_t count;
+    size_t i;
+    char *tmp_path;
+    FILE *fp;
+    int r = 0;
+
+    saved = malloc((cache->count ? cache->count : 1u) * sizeof(*saved));
+    if(saved == NULL)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    count = select_entries(cache, true, saved, 0, &bytes);
+    count = select_entries(cache, false, saved, count, &bytes);
+
+    fp = replace_open(path, &tmp_path);
+    if(fp == NULL)
+    {
+        free(saved);
+        return -1;
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, cache_magic, sizeof(cache_magic));
+    h.byte_order = CACHE_BYTE_ORDER;
+    h.count = count;
+    if(fwrite(&h, sizeof(h), 1, fp) != 1)
+    {
+        r = -1;
+    }
+
+    for(i = 0; (i < count) && (r == 0); i++)
+    {
+        const struct cache_entry *e = saved[i];
+        struct cache_record rec;
+
+        rec.hash = e->hash;
+        rec.fingerprint = e->fingerprint;
+        rec.data_size = e->data_size;
+        rec.sectors = e->sectors;
+        rec.access_errors = e->access_errors;
+        rec.text_len = e->text_len;
+        if((fwrite(&rec, sizeof(rec), 1, fp) != 1) ||
+           (fwrite(e->data, 1, e->data_size + e->text_len, fp) !=
+            e->data_size + e->text_len))
+        {
+            r = -1;
+        }
+    }
+    free(saved);
+
+    return replace_close(fp, path, tmp_path, r);
+}
+
+/**************************************************************************//**
+ * Looks the dump rendered by the settings up and appends its text to out.
+ * Returns 1 if it has been found, 0 if not and -1 on out of memory.
+ *****************************************************************************/
+int cache_lookup(struct dump_cache *cache, uint64_t hash, uint32_t fingerprint,
+                 const unsigned char *data, unsigned data_size,
+                 struct output *out, unsigned *sectors,
+                 unsigned *access_errors)
+{
+    struct cache_entry *e;
+    int r = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    e = &cache->slots[find_slot(cache, hash, fingerprint, data, data_size)];
+    if(e->data != NULL)
+    {
+        char *p = out_reserve(out, e->text_len);
+
+        if(p == NULL)
+        {
+            r = -1;
+        }
+        else
+        {
+            memcpy(p, &e->data[e->data_size], e->text_len);
+            out->len += e->text_len;
+            *sectors = e->sectors;
+            *access_errors = e->access_errors;
+            e->used = true;
+            cache->hits++;
+            r = 1;
+        }
+    }
+    else
+    {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Stores the text of the dump rendered by the settings. Returns -1 on out of
+ * memory.
+ *****************************************************************************/
+int cache_store(struct dump_cache *cache, uint64_t hash, uint32_t fingerprint,
+                const unsigned char *data, unsigned data_size,
+                const char *text, size_t text_len, unsigned sectors,
+                unsigned access_errors)
+{
+    struct cache_entry e;
+    size_t count;
+    int r;
+
+    e.hash = hash;
+    e.fingerprint = fingerprint;
+    e.data_size = data_size;
+    e.sectors = sectors;
+    e.access_errors = access_errors;
+    e.text_len = text_len;
+    e.data = NULL;
+    e.used = true;
+
+    pthread_mutex_lock(&cache->lock);
+    count = cache->count;
+    r = insert(cache, &e, data, text);
+    cache->stored += cache->count - count;
+    pthread_mutex_unlock(&cache->lock);
+
+    return r;
+}
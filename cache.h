@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Cache of the rendered output of dumps. Cards dumped many times give the
+ * same bytes, so the output is looked up by a hash of the dump and the
+ * output settings instead of being decoded and rendered again. The cache can
+ * be kept in a file between the runs.
+ *****************************************************************************/
+#ifndef CACHE_H
+#define CACHE_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "format.h"
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* rendered output of one dump, an empty slot has no data */
+struct cache_entry
+{
+    uint64_t hash;              /* XXH64 of the dump */
+    uint32_t fingerprint;       /* output settings the text was rendered by */
+    uint32_t data_size;
+    uint32_t sectors;
+    uint32_t access_errors;
+    size_t text_len;
+    unsigned char *data;        /* the dump followed by the text */
+    bool used;                  /* found or stored by this run */
+};
+
+/* open addressing hash table of the entries, shared by the worker threads */
+struct dump_cache
+{
+    struct cache_entry *slots;
+    size_t count;
+    size_t capacity;            /* power of two */
+    size_t stored;              /* entries added since loaded */
+    unsigned long hits;
+    unsigned long misses;
+    pthread_mutex_t lock;
+};
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int cache_init(struct dump_cache *cache);
+void cache_free(struct dump_cache *cache);
+int cache_load(struct dump_cache *cache, const char *path);
+int cache_save(struct dump_cache *cache, const char *path);
+
+int cache_lookup(struct dump_cache *cache, uint64_t hash, uint32_t fingerprint,
+                 const unsigned char *data, unsigned data_size,
+                 struct output *out, unsigned *sectors,
+                 unsigned *access_errors);
+int cache_store(struct dump_cache *cache, uint64_t hash, uint32_t fingerprint,
+                const unsigned char *data, unsigned data_size,
+                const char *text, size_t text_len, unsigned sectors,
+                unsigned access_errors);
+
+#endif /* CACHE_H */
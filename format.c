@@ -0,0 +1,1132 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Output formats of the decoded dumps
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "format.h"
+#if defined(MFD_DISPATCH_AVX2)
+#   include <immintrin.h>
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#   include <arm_neon.h>
+#endif
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* initial size of the output buffer of one dump */
+#define OUTPUT_INITIAL      8192u
+/* longest possible header of the table including colors */
+#define DUMP_HEADER_MAX     1024u
+/* longest possible JSON object of a dump */
+#define JSON_DUMP_MAX       16384u
+/* longest possible row of a block in the table including colors */
+#define ROW_MAX             192u
+
+#define HEX_DIGIT(d)    ((d) < 10 ? '0' + (d) : 'a' - 10 + (d))
+#define HEX_PAIR(i)     { HEX_DIGIT((i) >> 4), HEX_DIGIT((i) & 0x0f) },
+/* the same characters as isgraph() accepts in the "C" locale */
+#define ASCII_CHAR(i)   (((i) > 0x20) && ((i) < 0x7f) ? (i) : '.'),
+
+#define ANSI_CTRL_RESET                 "\x1B[0m"
+#define ANSI_CTRL_TEXT_RED              "\x1B[0;31m"
+#define ANSI_CTRL_TEXT_GREEN            "\x1B[0;32m"
+#define ANSI_CTRL_TEXT_BLUE             "\x1B[0;34m"
+#define ANSI_CTRL_TEXT_BOLD_INTENSIV_YELLOW  "\x1B[1;93m"
+
+/**************************************************************************//**
+ *                              PUBLIC VARIABLES
+ *****************************************************************************/
+const struct palette palette_ansi =
+{
+    ANSI_CTRL_TEXT_RED,
+    ANSI_CTRL_TEXT_BLUE,
+    ANSI_CTRL_TEXT_GREEN,
+    ANSI_CTRL_TEXT_BOLD_INTENSIV_YELLOW,
+    ANSI_CTRL_RESET
+};
+
+/* the ANSI codes are replaced by empty strings, so the color is not set */
+const struct palette palette_plain = { "", "", "", "", "" };
+
+/**************************************************************************//**
+ *                              PRIVATE VARIABLES
+ *****************************************************************************/
+static const char * const bit_rep[8] =
+{
+    "000", "001", "010", "011", "100", "101", "110", "111"
+};
+
+static const char * const permission_trailer[8] =
+{
+    "- A | A   - | A A",
+    "- A | A   A | A A [transport]",
+    "- - | A   - | A -",
+    "- B | A/B B | - B",
+    "- B | A/B - | - B",
+    "- - | A/B B | - -",
+    "- - | A/B - | - -",
+    "- - | A/B - | - -",
+};
+
+static const char * const permission_data[8] =
+{
+    "A/B | A/B   | A/B | A/B [transport]",
+    "A/B |  -    |  -  | A/B [value]",
+    "A/B |  -    |  -  |  -  [r/w]",
+    "  B |   B   |  -  |  -  [r/w]",
+    "A/B |   B   |  -  |  -  [r/w]",
+    "  B |  -    |  -  |  -  [r/w]",
+    "A/B |   B   |   B | A/B [value]",
+    " -  |  -    |  -  |  -  [r/w]",
+};
+
+/* lower case hex digits of all the byte values */
+static const char hex_table[256][2] =
+{
+    MFD_REPEAT256(HEX_PAIR, 0)
+};
+
+/* printable representation of all the byte values, '.' for the rest */
+static const char ascii_table[256] =
+{
+    MFD_REPEAT256(ASCII_CHAR, 0)
+};
+
+static const char separator_line[] =
+    "====================================================================================================\n";
+
+/**************************************************************************//**
+ * Writes a little endian word of len bytes.
+ *****************************************************************************/
+static void write_le(unsigned char *p, uint64_t value, unsigned len)
+{
+    unsigned i;
+
+    for(i = 0; i < len; i++)
+    {
+        p[i] = (unsigned char)(value >> (8u * i));
+    }
+}
+
+#if defined(MFD_DISPATCH_AVX2)
+/**************************************************************************//**
+ * Writes the 16 bytes as 32 hex digits by one lookup of all the nibbles.
+ *****************************************************************************/
+__attribute__((target("avx2")))
+static void hex_block_avx2(char *dst, const unsigned char *src)
+{
+    const __m256i digits = _mm256_setr_epi8(
+        '0', '1', '2', '3', '4', '5', '6', '7',
+        '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+        '0', '1', '2', '3', '4', '5', '6', '7',
+        '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    __m256i bytes = _mm256_cvtepu8_epi16(
+                        _mm_loadu_si128((const __m128i *)src));
+    /* the high nibble to the first character of the pair */
+    __m256i nibbles = _mm256_or_si256(
+        _mm256_srli_epi16(bytes, 4),
+        _mm256_slli_epi16(_mm256_and_si256(bytes, _mm256_set1_epi16(0x0f)),
+                          8));
+
+    _mm256_storeu_si256((__m256i *)dst, _mm256_shuffle_epi8(digits, nibbles));
+}
+#endif
+
+#if defined(__SSE2__)
+/**************************************************************************//**
+ * Returns the hex digits of the nibbles, SSE2 has no byte lookup.
+ *****************************************************************************/
+static __m128i hex_digits_sse2(__m128i nibbles)
+{
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+                                    _mm_set1_epi8('a' - '0' - 10));
+
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+/**************************************************************************//**
+ * Writes the 16 bytes as 32 hex digits.
+ *****************************************************************************/
+static void hex_block(char *dst, const unsigned char *src)
+{
+    __m128i bytes = _mm_loadu_si128((const __m128i *)src);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    __m128i low = _mm_and_si128(bytes, mask);
+
+    _mm_storeu_si128((__m128i *)dst,
+                     hex_digits_sse2(_mm_unpacklo_epi8(high, low)));
+    _mm_storeu_si128((__m128i *)&dst[16],
+                     hex_digits_sse2(_mm_unpackhi_epi8(high, low)));
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+/**************************************************************************//**
+ * Writes the 16 bytes as 32 hex digits, the store interleaves the digits of
+ * the high and the low nibbles.
+ *****************************************************************************/
+static void hex_block(char *dst, const unsigned char *src)
+{
+    static const uint8_t digits[16] =
+    {
+        '0', '1', '2', '3', '4', '5', '6', '7',
+        '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+    };
+    uint8x16_t table = vld1q_u8(digits);
+    uint8x16_t bytes = vld1q_u8(src);
+    uint8x16x2_t pairs;
+
+    pairs.val[0] = vqtbl1q_u8(table, vshrq_n_u8(bytes, 4));
+    pairs.val[1] = vqtbl1q_u8(table, vandq_u8(bytes, vdupq_n_u8(0x0f)));
+    vst2q_u8((uint8_t *)dst, pairs);
+}
+#endif
+
+/**************************************************************************//**
+ * Writes the bytes as hex pairs to dst. Returns the end of the written text,
+ * the string is not terminated. Whole blocks are rendered by the kernel of
+ * the CPU, the rest by the table.
+ *****************************************************************************/
+char *render_hex(char *dst, const unsigned char *src, unsigned len)
+{
+    unsigned i = 0;
+
+#if defined(MFD_DISPATCH_AVX2)
+    if((len >= MFD_BLOCK_SIZE) && (mfd_simd() == MFD_SIMD_AVX2))
+    {
+        for(; i + MFD_BLOCK_SIZE <= len; i += MFD_BLOCK_SIZE)
+        {
+            hex_block_avx2(&dst[i * 2u], &src[i]);
+        }
+    }
+#endif
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+    for(; i + MFD_BLOCK_SIZE <= len; i += MFD_BLOCK_SIZE)
+    {
+        hex_block(&dst[i * 2u], &src[i]);
+    }
+#endif
+    for(; i < len; i++)
+    {
+        memcpy(&dst[i * 2u], hex_table[src[i]], 2);
+    }
+
+    return &dst[len * 2u];
+}
+
+/**************************************************************************//**
+ * Writes the printable bytes to dst, others are replaced by '.'. Returns the
+ * end of the written text, the string is not terminated.
+ *****************************************************************************/
+char *render_ascii(char *dst, const unsigned char *src, unsigned len)
+{
+    unsigned i = 0;
+
+#if defined(__SSE2__)
+    for(; i + MFD_BLOCK_SIZE <= len; i += MFD_BLOCK_SIZE)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)&src[i]);
+        /* the bytes from 0x80 are negative, so they fail the first test */
+        __m128i printable = _mm_and_si128(
+            _mm_cmpgt_epi8(bytes, _mm_set1_epi8(0x20)),
+            _mm_cmplt_epi8(bytes, _mm_set1_epi8(0x7f)));
+
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_or_si128(
+            _mm_and_si128(printable, bytes),
+            _mm_andnot_si128(printable, _mm_set1_epi8('.'))));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for(; i + MFD_BLOCK_SIZE <= len; i += MFD_BLOCK_SIZE)
+    {
+        uint8x16_t bytes = vld1q_u8(&src[i]);
+        uint8x16_t printable = vandq_u8(vcgtq_u8(bytes, vdupq_n_u8(0x20)),
+                                        vcltq_u8(bytes, vdupq_n_u8(0x7f)));
+
+        vst1q_u8((uint8_t *)&dst[i],
+                 vbslq_u8(printable, bytes, vdupq_n_u8('.')));
+    }
+#endif
+    for(; i < len; i++)
+    {
+        dst[i] = ascii_table[src[i]];
+    }
+
+    return &dst[len];
+}
+
+/**************************************************************************//**
+ * Copies the string without the terminating zero to dst. Returns the end of
+ * the written text.
+ *****************************************************************************/
+static char *render_str(char *dst, const char *str)
+{
+    size_t len = strlen(str);
+
+    memcpy(dst, str, len);
+
+    return &dst[len];
+}
+
+/**************************************************************************//**
+ * Writes the decimal number to dst. Returns the end of the written text.
+ *****************************************************************************/
+static char *render_uint(char *dst, unsigned value)
+{
+    char digits[10];
+    unsigned n = 0;
+
+    do
+    {
+        digits[n++] = (char)('0' + value % 10u);
+        value /= 10u;
+    }
+    while(value > 0);
+
+    while(n > 0)
+    {
+        *dst++ = digits[--n];
+    }
+
+    return dst;
+}
+
+/**************************************************************************//**
+ * Pads the text written from field to end by spaces to the width.
+ * Returns the end of the padded field.
+ *****************************************************************************/
+static char *render_pad(char *field, char *end, unsigned width)
+{
+    while(end < field + width)
+    {
+        *end++ = ' ';
+    }
+
+    return end;
+}
+
+/**************************************************************************//**
+ * Checks whether the sector is selected to be rendered.
+ *****************************************************************************/
+static bool sector_selected(const struct format_options *opt, unsigned sector)
+{
+    return (opt->sectors >> sector) & 1u;
+}
+
+/**************************************************************************//**
+ * Returns the selected blocks of a sector of the given number of blocks as a
+ * mask, bit x for block x.
+ *****************************************************************************/
+static unsigned selected_blocks(const struct format_options *opt,
+                                unsigned blocks)
+{
+    return opt->blocks & ((1u << blocks) - 1u);
+}
+
+/**************************************************************************//**
+ * Appends formatted text to the output buffer. The buffer grows as needed.
+ *****************************************************************************/
+int out_printf(struct output *out, const char *format, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, format);
+    len = vsnprintf(out->data ? &out->data[out->len] : NULL,
+                    out->capacity - out->len, format, ap);
+    va_end(ap);
+    if(len < 0)
+    {
+        return len;
+    }
+
+    if(out->len + (size_t)len >= out->capacity)
+    {
+        size_t capacity = out->capacity ? out->capacity : OUTPUT_INITIAL;
+        char *data;
+
+        while(out->len + (size_t)len >= capacity)
+        {
+            capacity *= 2u;
+        }
+        data = realloc(out->data, capacity);
+        if(data == NULL)
+        {
+            return -1;
+        }
+        out->data = data;
+        out->capacity = capacity;
+
+        va_start(ap, format);
+        vsnprintf(&out->data[out->len], out->capacity - out->len, format, ap);
+        va_end(ap);
+    }
+    out->len += (size_t)len;
+
+    return len;
+}
+
+/**************************************************************************//**
+ * Makes sure at least size more bytes fit to the output buffer. Returns the
+ * end of the buffered text, where the caller can write directly, or NULL.
+ *****************************************************************************/
+char *out_reserve(struct output *out, size_t size)
+{
+    if(out->len + size > out->capacity)
+    {
+        size_t capacity = out->capacity ? out->capacity : OUTPUT_INITIAL;
+        char *data;
+
+        while(out->len + size > capacity)
+        {
+            capacity *= 2u;
+        }
+        data = realloc(out->data, capacity);
+        if(data == NULL)
+        {
+            return NULL;
+        }
+        out->data = data;
+        out->capacity = capacity;
+    }
+
+    return &out->data[out->len];
+}
+
+/**************************************************************************//**
+ * Shows the card type told by block 0 and how it matches the dump size.
+ *****************************************************************************/
+static void render_card(const struct mfd_dump *info, struct output *buf)
+{
+    if(info->card.type == MFD_CARD_UNKNOWN)
+    {
+        out_printf(buf, "\tCard: unknown SAK\n");
+    }
+    else if(info->dump_size > info->data_size)
+    {
+        out_printf(buf, "\tCard: Mifare Classic %s, %u bytes of padding ignored\n",
+                   mfd_card_name(info->card.type),
+                   info->dump_size - info->data_size);
+    }
+    else if(mfd_card_size(info->card.type) != info->data_size)
+    {
+        out_printf(buf, "\tCard: Mifare Classic %s, decoded by the dump size\n",
+                   mfd_card_name(info->card.type));
+    }
+    else
+    {
+        out_printf(buf, "\tCard: Mifare Classic %s\n",
+                   mfd_card_name(info->card.type));
+    }
+}
+
+/**************************************************************************//**
+ * Renders the decoded dump as the human readable table.
+ *****************************************************************************/
+int render_text(const struct mfd_dump *info, const struct format_options *opt,
+                struct output *buf)
+{
+    const unsigned char *data = info->data;
+    int sectors = (int)info->sectors;
+    char *out;
+    int sector;
+
+    /* the whole dump is rendered to the output buffer, which is allocated
+       once for the worst case size of the header and all the rows */
+    if(out_reserve(buf, DUMP_HEADER_MAX
+                   + (sectors + 1u) * (sizeof(separator_line) - 1u)
+                   + (info->data_size / 16u) * ROW_MAX) == NULL)
+    {
+        return -1;
+    }
+
+    out_printf(buf, "File size: %u bytes. Expected %d sectors\n",
+               info->dump_size, sectors);
+    /*
+     UID 4b:
+     11223344440804006263646566676869
+     ^^^^^^^^                         UID
+             ^^                       BCC
+               ^^                     SAK(*)
+                 ^^^^                 ATQA
+                     ^^^^^^^^^^^^^^^^ Manufacturer data
+     UID 7b:
+     04112233445566084400626364656667
+     ^^^^^^^^^^^^^^                   UID
+                   ^^                 SAK(*)
+                     ^^^^             ATQA
+                         ^^^^^^^^^^^^ Manufacturer data
+    */
+
+    if(info->card.uid_len == 7u)
+    {
+        /* 7 byte UID */
+        out_printf(buf, "\tUID: %02x%02x%02x%02x%02x%02x%02x\n", data[0],
+                   data[1], data[2], data[3], data[4], data[5], data[6]);
+    }
+    else
+    {
+        /* 4 byte UID */
+        out_printf(buf, "\tUID: %02x%02x%02x%02x\n", data[0], data[1], data[2], data[3]);
+        out_printf(buf, "\tBCC:  %02x\n", data[4]);
+    }
+    out_printf(buf, "\tSAK:  %02x\n", info->card.sak);
+    out_printf(buf, "\tATQA: %02x%02x\n", data[info->card.sak_offset + 1u],
+               data[info->card.sak_offset + 2u]);
+    render_card(info, buf);
+
+    out_printf(buf, "%s", separator_line);
+    out_printf(buf, "| Sect | Blck |            Data                  | Access |  r  |  w    |  i  | d/t/r [info]       |\n");
+    out_printf(buf, "|      |      |                                  |  cond. |   A | Acc.  | B                        |\n");
+    out_printf(buf, "|      |      | %sKey A%s      %sAccess Bits%s     %sKey B%s |        | r w | r   w | r w                      |\n",
+           opt->colors->keyA, opt->colors->reset, opt->colors->access,
+           opt->colors->reset, opt->colors->keyB, opt->colors->reset);
+    out = &buf->data[buf->len];
+
+    for(sector = 0; sector < sectors; sector++)
+    {
+        const struct mfd_sector *si = &info->sector[sector];
+        const unsigned char *keyA, *keyB, *access_bits;
+        char *field;
+        unsigned block;
+        unsigned blocks = si->blocks;
+        unsigned block_size = 16u;
+        unsigned shown = selected_blocks(opt, blocks);
+        unsigned label;
+
+        if(!sector_selected(opt, sector) || (shown == 0))
+        {
+            continue;
+        }
+
+        if(opt->compact && (sector > 0) && mfd_sector_is_default(&data[si->start], blocks))
+        {
+            /* collapse the run of untouched sectors to one line */
+            int last = sector;
+
+            while((last + 1 < sectors) && sector_selected(opt, last + 1) &&
+                  mfd_sector_is_default(&data[info->sector[last + 1].start],
+                                    info->sector[last + 1].blocks))
+            {
+                last++;
+            }
+
+            out = render_str(out, separator_line);
+            out = render_str(out, "| ");
+            field = out;
+            out = render_uint(out, sector);
+            if(last > sector)
+            {
+                *out++ = '-';
+                out = render_uint(out, last);
+            }
+            out = render_pad(field, out, 5);
+            out = render_str(out, "|  *   | ");
+            out = render_str(out, opt->colors->access);
+            out = render_str(out, "empty data, transport trailer ");
+            out = render_str(out, opt->colors->keyA);
+            out = render_str(out, "ffffffffffff ");
+            out = render_str(out, opt->colors->access);
+            out = render_str(out, "ff078069 ");
+            out = render_str(out, opt->colors->keyB);
+            out = render_str(out, "ffffffffffff");
+            out = render_str(out, opt->colors->reset);
+            *out++ = '\n';
+
+            sector = last;
+            continue;
+        }
+
+        keyA = &data[si->trailer + 0];
+        keyB = &data[si->trailer + 10];
+        access_bits = &data[si->trailer + 6];
+        out = render_str(out, separator_line);
+
+        /* the sector number is shown next to the 2nd block, or to the 1st
+           selected one if the 2nd is not shown */
+        for(label = (shown & 2u) ? 1u : 0; !(shown & (1u << label)); label++)
+        {
+        }
+
+        for(block = 0; block < blocks; block++)
+        {
+            unsigned block_start = si->start + block * block_size;
+            int access_condition;
+            const char *permissions;
+
+            if(!(shown & (1u << block)))
+            {
+                continue;
+            }
+            access_condition = mfd_block_condition(&si->ac, sector, block);
+
+            /* show sector number nexto to each 2nd block */
+            out = render_str(out, "| ");
+            field = out;
+            if(block == label)
+            {
+                out = render_uint(out, sector);
+            }
+            out = render_pad(field, out, 5);
+
+            out = render_str(out, "|  ");
+            field = out;
+            out = render_uint(out, block);
+            out = render_pad(field, out, 3);
+            out = render_str(out, " | ");
+
+            /* prepare data in hex format */
+            if(block == blocks-1)
+            {
+                /* the trailer contains keys and access bits */
+                out = render_str(out, opt->colors->keyA);
+                out = render_hex(out, keyA, 6);
+                out = render_str(out, opt->colors->access);
+                out = render_hex(out, access_bits, 4);
+                out = render_str(out, opt->colors->keyB);
+                out = render_hex(out, keyB, 6);
+                out = render_str(out, opt->colors->reset);
+            }
+            else
+            {
+                /* print data of one block */
+                out = render_hex(out, &data[block_start], block_size);
+            }
+            out = render_str(out, " |  ");
+
+            if((access_condition < 0) || (access_condition > 7))
+            {
+                /* invalid access bits */
+                out = render_str(out, opt->colors->warning);
+                out = render_str(out, "ERR");
+                permissions = "";
+            }
+            else
+            {
+                /* prepare access bits in bin format */
+                out = render_str(out, opt->colors->access);
+                out = render_str(out, bit_rep[access_condition]);
+
+                if((block == 0) && (sector == 0))
+                {
+                    /* The 1st block in the 1st sector contains Manufacturer
+                       data that it's not possible to change */
+                    permissions = "-";
+                }
+                else if(block == blocks-1)
+                {
+                    permissions = permission_trailer[access_condition];
+                }
+                else
+                {
+                    permissions = permission_data[access_condition];
+                }
+            }
+            out = render_str(out, opt->colors->reset);
+            out = render_str(out, "   | ");
+            field = out;
+            out = render_str(out, permissions);
+            out = render_pad(field, out, 38);
+            out = render_str(out, " | ");
+
+            /* print data of one block in ASCII */
+            out = render_ascii(out, &data[block_start], block_size);
+            *out++ = '\n';
+        }
+    }
+    out = render_str(out, separator_line);
+    buf->len = (size_t)(out - buf->data);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Appends the access condition of the block group with its permissions, or
+ * ERR if the access bits of the group are invalid.
+ *****************************************************************************/
+static void diff_condition(struct output *out, const struct format_options *opt,
+                           const struct mfd_access *ac, unsigned group)
+{
+    if(!(ac->valid & (1u << group)))
+    {
+        out_printf(out, "%sERR%s", opt->colors->warning, opt->colors->reset);
+        return;
+    }
+
+    out_printf(out, "%s%s%s %s", opt->colors->access, bit_rep[ac->cond[group]],
+               opt->colors->reset, (group == 3u) ? permission_trailer[ac->cond[group]]
+                                                : permission_data[ac->cond[group]]);
+}
+
+/**************************************************************************//**
+ * Appends one block of the diff, the trailer with its keys colored like in
+ * the table.
+ *****************************************************************************/
+static void diff_block(struct output *out, const struct format_options *opt,
+                       char mark, const unsigned char *block, bool trailer)
+{
+    char line[2u * MFD_BLOCK_SIZE + MFD_BLOCK_SIZE];
+
+    if(trailer)
+    {
+        render_hex(line, &block[0], 6);
+        render_hex(&line[12], &block[6], 4);
+        render_hex(&line[20], &block[10], 6);
+        out_printf(out, "%c %s%.12s %s%.8s %s%.12s%s\n", mark, opt->colors->keyA,
+                   &line[0], opt->colors->access, &line[12],
+                   opt->colors->keyB, &line[20], opt->colors->reset);
+    }
+    else
+    {
+        render_hex(line, block, MFD_BLOCK_SIZE);
+        render_ascii(&line[2u * MFD_BLOCK_SIZE], block, MFD_BLOCK_SIZE);
+        out_printf(out, "%c %.32s | %.16s\n", mark, line,
+                   &line[2u * MFD_BLOCK_SIZE]);
+    }
+}
+
+/**************************************************************************//**
+ * Renders the blocks which differ between two dumps of the same size. The
+ * changes of access conditions decoded from the modified trailers are shown
+ * for every block group. Nothing is written for equal dumps. The number of
+ * changed blocks is stored to changed_blocks.
+ *****************************************************************************/
+int render_diff(const char *name_a, const struct mfd_dump *a,
+                const char *name_b, const struct mfd_dump *b,
+                const struct format_options *opt, struct output *out,
+                unsigned *changed_blocks)
+{
+    uint64_t changed[MFD_MAX_BLOCKS / 64u];
+    unsigned blocks = a->data_size / MFD_BLOCK_SIZE;
+    unsigned sector;
+
+    *changed_blocks = mfd_diff_blocks(a->data, b->data, blocks, changed);
+    if(*changed_blocks == 0)
+    {
+        return 0;
+    }
+
+    out_printf(out, "--- %s\n+++ %s\n", name_a, name_b);
+
+    for(sector = 0; sector < a->sectors; sector++)
+    {
+        const struct mfd_sector *sa = &a->sector[sector];
+        const struct mfd_sector *sb = &b->sector[sector];
+        unsigned first = sa->start / MFD_BLOCK_SIZE;
+        unsigned block;
+
+        for(block = 0; block < sa->blocks; block++)
+        {
+            unsigned x = first + block;
+            bool trailer = (block == sa->blocks - 1u);
+            unsigned group;
+
+            if(!(changed[x / 64u] & ((uint64_t)1 << (x % 64u))))
+            {
+                continue;
+            }
+
+            out_printf(out, "Sector %u, block %u%s\n", sector, block,
+                       trailer ? " (trailer)" : "");
+            diff_block(out, opt, '-', &a->data[x * MFD_BLOCK_SIZE], trailer);
+            diff_block(out, opt, '+', &b->data[x * MFD_BLOCK_SIZE], trailer);
+            if(!trailer)
+            {
+                continue;
+            }
+
+            for(group = 0; group < 4u; group++)
+            {
+                unsigned bit = 1u << group;
+
+                if(((sa->ac.valid & bit) == (sb->ac.valid & bit)) &&
+                   (!(sa->ac.valid & bit) ||
+                    (sa->ac.cond[group] == sb->ac.cond[group])))
+                {
+                    continue;
+                }
+                if(group == 3u)
+                {
+                    out_printf(out, "  trailer: ");
+                }
+                else if(sa->blocks > 4u)
+                {
+                    out_printf(out, "  blocks %u-%u: ", group * 5u,
+                               group * 5u + 4u);
+                }
+                else
+                {
+                    out_printf(out, "  block %u: ", group);
+                }
+                diff_condition(out, opt, &sa->ac, group);
+                out_printf(out, " -> ");
+                diff_condition(out, opt, &sb->ac, group);
+                out_printf(out, "\n");
+            }
+        }
+    }
+    out_printf(out, "%u of %u blocks changed\n", *changed_blocks, blocks);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Appends the text as a JSON string including the quotes.
+ *****************************************************************************/
+static void json_string(struct output *out, const char *str)
+{
+    const char *p;
+
+    out_printf(out, "\"");
+    for(p = str; *p; p++)
+    {
+        unsigned char c = (unsigned char)*p;
+
+        if((c == '"') || (c == '\\'))
+        {
+            out_printf(out, "\\%c", c);
+        }
+        else if(c < 0x20)
+        {
+            out_printf(out, "\\u%04x", c);
+        }
+        else
+        {
+            out_printf(out, "%c", c);
+        }
+    }
+    out_printf(out, "\"");
+}
+
+/**************************************************************************//**
+ * Appends the bytes as a JSON string of hex pairs.
+ *****************************************************************************/
+static void json_hex(struct output *out, const unsigned char *data, unsigned len)
+{
+    char *p = out_reserve(out, len * 2u + 2u);
+
+    if(p != NULL)
+    {
+        *p++ = '"';
+        p = render_hex(p, data, len);
+        *p++ = '"';
+        out->len = (size_t)(p - out->data);
+    }
+}
+
+/**************************************************************************//**
+ * Renders the beginning of the JSON object up to the name of the dump. The
+ * rest does not depend on the name and is rendered by render_json_body().
+ *****************************************************************************/
+int render_json_head(const char *name, const struct format_options *opt,
+                     struct output *out)
+{
+    const char *nl = (opt->format == FORMAT_NDJSON) ? "" : "\n";
+    const char *indent = (opt->format == FORMAT_NDJSON) ? "" : "  ";
+
+    if(opt->json_array)
+    {
+        /* the objects are items of one array, write_result() drops the comma
+           of the first one */
+        out_printf(out, ",");
+    }
+    out_printf(out, "{%s%s\"file\":", nl, indent);
+    json_string(out, name);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Renders the decoded dump as the rest of the JSON object following the name.
+ *****************************************************************************/
+int render_json_body(const struct mfd_dump *info,
+                     const struct format_options *opt, struct output *out)
+{
+    const unsigned char *data = info->data;
+    const char *nl = (opt->format == FORMAT_NDJSON) ? "" : "\n";
+    const char *indent = (opt->format == FORMAT_NDJSON) ? "" : "  ";
+    unsigned sector;
+    bool first = true;
+
+    if(out_reserve(out, JSON_DUMP_MAX) == NULL)
+    {
+        return -1;
+    }
+
+    out_printf(out, ",%s%s\"size\":%u,\"sectors\":%u,\"invalid_trailers\":%u,",
+               nl, indent, info->dump_size, info->sectors, info->access_errors);
+    out_printf(out, "%s%s\"uid\":", nl, indent);
+    json_hex(out, &data[0], info->card.uid_len);
+    out_printf(out, ",\"bcc\":");
+    if(info->card.uid_len == 4u)
+    {
+        json_hex(out, &data[4], 1);
+    }
+    else
+    {
+        out_printf(out, "null");
+    }
+    out_printf(out, ",\"sak\":");
+    json_hex(out, &data[info->card.sak_offset], 1);
+    out_printf(out, ",\"atqa\":");
+    json_hex(out, &data[info->card.sak_offset + 1u], 2);
+    if(info->card.type == MFD_CARD_UNKNOWN)
+    {
+        out_printf(out, ",\"card\":null");
+    }
+    else
+    {
+        out_printf(out, ",\"card\":\"%s\"", mfd_card_name(info->card.type));
+    }
+    out_printf(out, ",%s%s\"sector_list\":[", nl, indent);
+
+    for(sector = 0; sector < info->sectors; sector++)
+    {
+        const struct mfd_sector *si = &info->sector[sector];
+        unsigned i;
+
+        if(!sector_selected(opt, sector))
+        {
+            continue;
+        }
+        out_printf(out, "%s%s%s{\"sector\":%u,\"key_a\":", first ? "" : ",",
+                   nl, indent, sector);
+        first = false;
+        json_hex(out, &data[si->trailer], 6);
+        out_printf(out, ",\"access_bits\":");
+        json_hex(out, &data[si->trailer + 6u], 4);
+        out_printf(out, ",\"key_b\":");
+        json_hex(out, &data[si->trailer + 10u], 6);
+        out_printf(out, ",\"access_valid\":%s,\"conditions\":[",
+                   (si->ac.valid == 0x0fu) ? "true" : "false");
+        for(i = 0; i < 4u; i++)
+        {
+            if(si->ac.valid & (1u << i))
+            {
+                out_printf(out, "%s%u", i ? "," : "", si->ac.cond[i]);
+            }
+            else
+            {
+                out_printf(out, "%snull", i ? "," : "");
+            }
+        }
+        out_printf(out, "],\"blocks\":[");
+        for(i = 0; i < si->blocks; i++)
+        {
+            if(i > 0)
+            {
+                out_printf(out, ",");
+            }
+            if(selected_blocks(opt, si->blocks) & (1u << i))
+            {
+                json_hex(out, &data[si->start + i * 16u], 16);
+            }
+            else
+            {
+                out_printf(out, "null");
+            }
+        }
+        out_printf(out, "]}");
+    }
+    out_printf(out, "%s%s]%s}\n", nl, indent, nl);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Renders the decoded dump as one JSON object. The object is on a single line
+ * for the NDJSON output.
+ *****************************************************************************/
+int render_json(const char *name, const struct mfd_dump *info,
+                const struct format_options *opt, struct output *out)
+{
+    if(out_reserve(out, JSON_DUMP_MAX) == NULL)
+    {
+        return -1;
+    }
+    render_json_head(name, opt, out);
+
+    return render_json_body(info, opt, out);
+}
+
+/**************************************************************************//**
+ * Renders only the value blocks of the dump: the data blocks configured as
+ * value blocks by their access conditions and the blocks having the layout
+ * of a value block. The text is one line per block; for JSON it is the rest
+ * of the object following the name written by render_json_head().
+ *****************************************************************************/
+int render_values(const struct mfd_dump *info, const struct format_options *opt,
+                  struct output *out)
+{
+    const unsigned char *data = info->data;
+    bool json = (opt->format != FORMAT_TEXT);
+    const char *nl = (opt->format == FORMAT_NDJSON) ? "" : "\n";
+    const char *indent = (opt->format == FORMAT_NDJSON) ? "" : "  ";
+    unsigned sector;
+    unsigned found = 0;
+
+    if(json)
+    {
+        out_printf(out, ",%s%s\"size\":%u,\"uid\":", nl, indent,
+                   info->dump_size);
+        json_hex(out, &data[0], info->card.uid_len);
+        out_printf(out, ",%s%s\"values\":[", nl, indent);
+    }
+    else
+    {
+        char uid[2u * 7u + 1u];
+        /* a UID has 4 or 7 bytes */
+        unsigned uid_len = (info->card.uid_len == 7u) ? 7u : 4u;
+
+        *render_hex(uid, data, uid_len) = '\0';
+        out_printf(out, "UID: %s, %u bytes\n", uid, info->dump_size);
+    }
+
+    for(sector = 0; sector < info->sectors; sector++)
+    {
+        const struct mfd_sector *si = &info->sector[sector];
+        unsigned shown = selected_blocks(opt, si->blocks);
+        unsigned block;
+
+        if(!sector_selected(opt, sector))
+        {
+            continue;
+        }
+
+        /* the trailer and the manufacturer block never hold a value */
+        for(block = (sector == 0) ? 1u : 0; block + 1u < si->blocks; block++)
+        {
+            int condition = mfd_block_condition(&si->ac, sector, block);
+            struct mfd_value v;
+
+            if(!(shown & (1u << block)))
+            {
+                continue;
+            }
+            mfd_decode_value(&data[si->start + block * MFD_BLOCK_SIZE], &v);
+            if(!v.valid && !mfd_is_value_condition(condition))
+            {
+                continue;
+            }
+
+            if(json)
+            {
+                out_printf(out, "%s%s%s{\"sector\":%u,\"block\":%u,"
+                           "\"value\":%ld,\"address\":%u,\"valid\":%s,"
+                           "\"condition\":", found ? "," : "", nl, indent,
+                           sector, block, (long)v.value, v.address,
+                           v.valid ? "true" : "false");
+                if(condition < 0)
+                {
+                    out_printf(out, "null}");
+                }
+                else
+                {
+                    out_printf(out, "%d}", condition);
+                }
+            }
+            else
+            {
+                out_printf(out, "Sector %u, block %u: ", sector, block);
+                if(v.valid)
+                {
+                    out_printf(out, "value %ld, address %u", (long)v.value,
+                               v.address);
+                }
+                else
+                {
+                    out_printf(out, "%sinvalid value block%s",
+                               opt->colors->warning, opt->colors->reset);
+                }
+                if(condition < 0)
+                {
+                    out_printf(out, ", access %sERR%s\n", opt->colors->warning,
+                               opt->colors->reset);
+                }
+                else
+                {
+                    out_printf(out, ", access %s%s%s %s\n", opt->colors->access,
+                               bit_rep[condition], opt->colors->reset,
+                               permission_data[condition]);
+                }
+            }
+            found++;
+        }
+    }
+
+    if(json)
+    {
+        out_printf(out, "%s%s]%s}\n", nl, indent, nl);
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Renders the decoded dump as fixed size binary records, one per sector.
+ * The layout of the record is described at SECTOR_RECORD_SIZE.
+ *****************************************************************************/
+int render_binary(const struct mfd_dump *info, const struct format_options *opt,
+                  struct output *buf)
+{
+    const unsigned char *data = info->data;
+    unsigned char *out;
+    unsigned char *first;
+    unsigned sector;
+
+    out = (unsigned char *)out_reserve(buf,
+                                       info->sectors * SECTOR_RECORD_SIZE);
+    if(out == NULL)
+    {
+        return -1;
+    }
+    first = out;
+
+    for(sector = 0; sector < info->sectors; sector++)
+    {
+        const struct mfd_sector *si = &info->sector[sector];
+        unsigned conditions = si->ac.cond[0] | (si->ac.cond[1] << 3) |
+                              (si->ac.cond[2] << 6) | (si->ac.cond[3] << 9);
+
+        if(!sector_selected(opt, sector))
+        {
+            continue;
+        }
+        memset(out, 0, SECTOR_RECORD_SIZE);
+        memcpy(&out[0], &data[0], info->card.uid_len);
+        out[7] = info->card.uid_len;
+        out[8] = (unsigned char)sector;
+        out[9] = si->ac.valid;
+        write_le(&out[10], conditions, 2);
+        memcpy(&out[12], &data[si->trailer], 6);
+        memcpy(&out[18], &data[si->trailer + 10u], 6);
+        write_le(&out[24], mfd_xxh64(&data[si->start], si->trailer - si->start), 8);
+        out += SECTOR_RECORD_SIZE;
+    }
+    buf->len += (size_t)(out - first);
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Output formats of the decoded dumps: the human readable table, JSON and
+ * the binary sector records. All of them render to a memory buffer.
+ *****************************************************************************/
+#ifndef FORMAT_H
+#define FORMAT_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mfd.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+#define FORMAT_TEXT         0
+#define FORMAT_JSON         1
+#define FORMAT_NDJSON       2
+#define FORMAT_BINARY       3
+
+/* Size of the binary record of one sector, all numbers are little endian:
+     0  UID, unused bytes are zero       (7 bytes)
+     7  length of the UID                (1)
+     8  sector number                    (1)
+     9  valid access bits, bit x for block group x (1)
+    10  access conditions C1x C2x C3x, bits 3x to 3x+2 (2)
+    12  key A                            (6)
+    18  key B                            (6)
+    24  XXH64 digest of the data blocks, trailer excluded (8) */
+#define SECTOR_RECORD_SIZE  32u
+
+/* selections of format_options rendering the whole dump */
+#define FORMAT_ALL_SECTORS  MFD_ALL_SECTORS
+#define FORMAT_ALL_BLOCKS   0xffffu
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* growing text buffer collecting the output of one dump */
+struct output
+{
+    char *data;
+    size_t len;
+    size_t capacity;
+};
+
+/* control sequences coloring the parts of the table */
+struct palette
+{
+    const char *keyA;
+    const char *keyB;
+    const char *access;
+    const char *warning;
+    const char *reset;
+};
+
+/* settings shared by all the renderers */
+struct format_options
+{
+    int format;
+    bool compact;               /* collapse runs of untouched sectors */
+    bool values_only;           /* show the value blocks instead of the table */
+    bool json_array;            /* JSON objects are items of one array */
+    const struct palette *colors;
+    uint64_t sectors;           /* bit x selects sector x to be rendered */
+    uint16_t blocks;            /* bit x selects block x of every sector */
+};
+
+/**************************************************************************//**
+ *                              PUBLIC VARIABLES
+ *****************************************************************************/
+extern const struct palette palette_ansi;
+extern const struct palette palette_plain;
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int out_printf(struct output *out, const char *format, ...);
+char *out_reserve(struct output *out, size_t size);
+
+char *render_hex(char *dst, const unsigned char *src, unsigned len);
+char *render_ascii(char *dst, const unsigned char *src, unsigned len);
+
+int render_text(const struct mfd_dump *info, const struct format_options *opt,
+                struct output *buf);
+int render_json(const char *name, const struct mfd_dump *info,
+                const struct format_options *opt, struct output *out);
+int render_json_head(const char *name, const struct format_options *opt,
+                     struct output *out);
+int render_json_body(const struct mfd_dump *info,
+                     const struct format_options *opt, struct output *out);
+int render_binary(const struct mfd_dump *info, const struct format_options *opt,
+                  struct output *buf);
+int render_values(const struct mfd_dump *info, const struct format_options *opt,
+                  struct output *out);
+int render_diff(const char *name_a, const struct mfd_dump *a,
+                const char *name_b, const struct mfd_dump *b,
+                const struct format_options *opt, struct output *out,
+                unsigned *changed_blocks);
+
+#endif /* FORMAT_H */
@@ -0,0 +1,174 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * libFuzzer harness of the decoder and the renderers. Every input is decoded
+ * as a dump and, if it has the size of a card, rendered in all the output
+ * formats, so any read outside of the dump is found by the sanitizers. The
+ * inputs detected as text dumps are converted by the import parsers too and
+ * every input is read as a tar and as a zip archive by the archive readers.
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "archive.h"
+#include "format.h"
+#include "import.h"
+#include "mfd.h"
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Accepts the archive members of any size.
+ *****************************************************************************/
+static bool any_member(uint64_t size)
+{
+    (void)size;
+    return true;
+}
+
+/**************************************************************************//**
+ * Touches every byte of the member, so a member reaching outside of the
+ * buffer of the reader is found by the sanitizers.
+ *****************************************************************************/
+static int read_member(void *ctx, const char *name, const unsigned char *data,
+                       size_t size)
+{
+    unsigned *sum = ctx;
+    size_t i;
+
+    *sum += (unsigned)strlen(name);
+    for(i = 0; i < size; i++)
+    {
+        *sum += data[i];
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Reads the input as an archive of the kind, through a memory stream.
+ *****************************************************************************/
+static void read_archive(unsigned char *data, size_t size, int kind,
+                         struct output *err)
+{
+    unsigned failed = 0;
+    unsigned sum = 0;
+    FILE *fp;
+
+    if(size == 0)
+    {
+        return;
+    }
+    fp = fmemopen(data, size, "rb");
+    if(fp != NULL)
+    {
+        archive_read_file(fp, "fuzz", kind, MFD_MAX_DUMP_SIZE, any_member,
+                          read_member, &sum, err, &failed);
+        fclose(fp);
+    }
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/**************************************************************************//**
+ * Decodes and renders one input. The dump is copied to a buffer of its exact
+ * size, so the sanitizer catches a read of even one byte behind it.
+ *****************************************************************************/
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    struct format_options opt = { FORMAT_TEXT, false, false, false,
+                                  &palette_ansi,
+                                  FORMAT_ALL_SECTORS, FORMAT_ALL_BLOCKS };
+    struct output out = { NULL, 0, 0 };
+    struct mfd_dump info;
+    unsigned char *dump;
+    unsigned sector, block;
+
+    dump = malloc(size ? size : 1u);
+    if(dump == NULL)
+    {
+        return 0;
+    }
+    memcpy(dump, data, size);
+
+    if(import_detect(dump, size) != IMPORT_NONE)
+    {
+        unsigned char text_dump[MFD_MAX_DUMP_SIZE];
+        size_t text_size;
+        unsigned long line;
+
+        import_parse(import_detect(dump, size), dump, size, text_dump,
+                     &text_size, &line);
+    }
+
+    read_archive(dump, size, ARCHIVE_TAR, &out);
+    read_archive(dump, size, ARCHIVE_ZIP, &out);
+
+    if(mfd_decode(dump, size, &info) == MFD_OK)
+    {
+        for(sector = 0; sector < info.sectors; sector++)
+        {
+            const struct mfd_sector *si = &info.sector[sector];
+
+            for(block = 0; block < si->blocks; block++)
+            {
+                struct mfd_value v;
+
+                mfd_get_access_condition(sector, block,
+                                         &dump[si->trailer + 6u]);
+                mfd_decode_value(&dump[si->start + block * MFD_BLOCK_SIZE], &v);
+            }
+            mfd_sector_is_default(&dump[si->start], si->blocks);
+        }
+
+        render_text(&info, &opt, &out);
+        opt.compact = true;
+        render_text(&info, &opt, &out);
+        render_values(&info, &opt, &out);
+        opt.format = FORMAT_JSON;
+        opt.json_array = true;
+        render_json("fuzz", &info, &opt, &out);
+        opt.format = FORMAT_NDJSON;
+        render_json("fuzz", &info, &opt, &out);
+        render_binary(&info, &opt, &out);
+        render_diff("a", &info, "b", &info, &opt, &out, &block);
+        /* a partial selection, the first sectors and blocks are left out */
+        opt.sectors = 0xaaaaaaaaaaull;
+        opt.blocks = 0xaaaau;
+        render_json("fuzz", &info, &opt, &out);
+        render_binary(&info, &opt, &out);
+        render_values(&info, &opt, &out);
+        opt.format = FORMAT_TEXT;
+        render_text(&info, &opt, &out);
+    }
+
+    free(out.data);
+    free(dump);
+
+    return 0;
+}
@@ -0,0 +1,612 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Dumps saved as text by other tools converted to the binary layout
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "import.h"
+#include "mfd.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* not a hex digit in hex_values, any of the bits 4 to 7 tells it */
+#define XX                  0xffu
+#define HEX_BAD             0xf0u
+
+#define UTF8_BOM            "\xef\xbb\xbf"
+#define FLIPPER_HEADER      "Filetype: Flipper NFC device"
+
+/**************************************************************************//**
+ *                          PRIVATE VARIABLES
+ *****************************************************************************/
+/* values of the hex digits by their characters */
+static const uint8_t hex_values[256] =
+{
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, XX, XX, XX, XX, XX, XX,
+    XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+
+static const char *const import_names[] =
+{
+    "raw", "hex text", "Proxmark3 JSON", "Flipper NFC"
+};
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Decodes pairs of hex digits up to the first other character, at most max
+ * bytes. Whole blocks of 32 digits are decoded by table lookups without a
+ * branch per digit, the invalid characters are checked once per block.
+ * Returns the number of bytes decoded.
+ *****************************************************************************/
+static size_t decode_hex(unsigned char *dst, const unsigned char *src,
+                         size_t max)
+{
+    size_t n = 0;
+
+    while(n + MFD_BLOCK_SIZE <= max)
+    {
+        unsigned bad = 0;
+        unsigned i;
+
+        for(i = 0; i < MFD_BLOCK_SIZE; i++)
+        {
+            unsigned hi = hex_values[src[2u * i]];
+            unsigned lo = hex_values[src[2u * i + 1u]];
+
+            bad |= hi | lo;
+            dst[n + i] = (unsigned char)((hi << 4) | lo);
+        }
+        if(bad & HEX_BAD)
+        {
+            /* the rest is decoded digit by digit up to the bad one */
+            break;
+        }
+        src += 2u * MFD_BLOCK_SIZE;
+        n += MFD_BLOCK_SIZE;
+    }
+
+    while(n < max)
+    {
+        unsigned hi = hex_values[src[0]];
+        unsigned lo = hex_values[src[1]];
+
+        if((hi | lo) & HEX_BAD)
+        {
+            break;
+        }
+        dst[n++] = (unsigned char)((hi << 4) | lo);
+        src += 2;
+    }
+
+    return n;
+}
+
+/**************************************************************************//**
+ * Returns the smaller of the sizes.
+ *****************************************************************************/
+static size_t min_size(size_t a, size_t b)
+{
+    return (a < b) ? a : b;
+}
+
+/**************************************************************************//**
+ * Checks whether the text at p starts by the string.
+ *****************************************************************************/
+static bool starts_with(const unsigned char *p, const unsigned char *end,
+                        const char *s)
+{
+    size_t len = strlen(s);
+
+    return ((size_t)(end - p) >= len) && (memcmp(p, s, len) == 0);
+}
+
+/**************************************************************************//**
+ * Skips the byte order mark written by some editors.
+ *****************************************************************************/
+static const unsigned char *skip_bom(const unsigned char *p,
+                                     const unsigned char *end)
+{
+    return starts_with(p, end, UTF8_BOM) ? p + strlen(UTF8_BOM) : p;
+}
+
+/**************************************************************************//**
+ * Skips spaces and line breaks.
+ *****************************************************************************/
+static const unsigned char *skip_space(const unsigned char *p,
+                                       const unsigned char *end)
+{
+    while((p < end) &&
+          ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n')))
+    {
+        p++;
+    }
+
+    return p;
+}
+
+/**************************************************************************//**
+ * Skips spaces on the line.
+ *****************************************************************************/
+static const unsigned char *skip_blank(const unsigned char *p,
+                                       const unsigned char *end)
+{
+    while((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\r')))
+    {
+        p++;
+    }
+
+    return p;
+}
+
+/**************************************************************************//**
+ * Returns the end of the line at p, the line break or the end of the text.
+ *****************************************************************************/
+static const unsigned char *line_end(const unsigned char *p,
+                                     const unsigned char *end)
+{
+    const unsigned char *eol = memchr(p, '\n', (size_t)(end - p));
+
+    return (eol != NULL) ? eol : end;
+}
+
+/**************************************************************************//**
+ * Returns the number of the line holding pos, counted from 1.
+ *****************************************************************************/
+static unsigned long line_of(const unsigned char *text,
+                             const unsigned char *pos)
+{
+    unsigned long line = 1;
+
+    while((text = memchr(text, '\n', (size_t)(pos - text))) != NULL)
+    {
+        line++;
+        text++;
+    }
+
+    return line;
+}
+
+/**************************************************************************//**
+ * Skips the character c after optional spaces. On failure p is left at the
+ * unexpected character.
+ *****************************************************************************/
+static bool take(const unsigned char **p, const unsigned char *end, char c)
+{
+    *p = skip_space(*p, end);
+    if((*p < end) && (**p == (unsigned char)c))
+    {
+        (*p)++;
+        return true;
+    }
+
+    return false;
+}
+
+/**************************************************************************//**
+ * Reads a decimal block number below MFD_MAX_BLOCKS.
+ *****************************************************************************/
+static bool take_block(const unsigned char **p, const unsigned char *end,
+                       unsigned *block)
+{
+    const unsigned char *start = *p;
+    unsigned n = 0;
+
+    while((*p < end) && (**p >= '0') && (**p <= '9') && (n < MFD_MAX_BLOCKS))
+    {
+        n = n * 10u + (unsigned)(**p - '0');
+        (*p)++;
+    }
+    if((*p == start) || (n >= MFD_MAX_BLOCKS))
+    {
+        *p = start;
+        return false;
+    }
+    *block = n;
+
+    return true;
+}
+
+/**************************************************************************//**
+ * Parses hex text: pairs of hex digits, which may be separated by spaces,
+ * colons and line breaks, the text after # is a comment. The .eml dumps of
+ * the Proxmark3 are this format with one block per line. Returns NULL or the
+ * position of the error.
+ *****************************************************************************/
+static const unsigned char *parse_hex(const unsigned char *p,
+                                      const unsigned char *end,
+                                      unsigned char *dump, size_t *size)
+{
+    size_t n = 0;
+
+    while(p < end)
+    {
+        if((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n') ||
+           (*p == ':'))
+        {
+            p++;
+        }
+        else if(*p == '#')
+        {
+            p = line_end(p, end);
+        }
+        else
+        {
+            size_t bytes = decode_hex(&dump[n], p,
+                                      min_size(MFD_MAX_DUMP_SIZE - n,
+                                               (size_t)(end - p) / 2u));
+
+            p += 2u * bytes;
+            n += bytes;
+            /* an odd digit, a digit over the biggest dump or garbage */
+            if((bytes == 0) || ((p < end) && (hex_values[*p] != XX)))
+            {
+                return p;
+            }
+        }
+    }
+    *size = n;
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * Finds the object of the blocks in a Proxmark3 JSON dump and returns the
+ * position after its opening brace or NULL. Just the strings are followed,
+ * the rest of the document is not parsed.
+ *****************************************************************************/
+static const unsigned char *find_json_blocks(const unsigned char *p,
+                                             const unsigned char *end)
+{
+    while((p = memchr(p, '"', (size_t)(end - p))) != NULL)
+    {
+        const unsigned char *key = ++p;
+
+        while((p < end) && (*p != '"'))
+        {
+            /* escaped characters */
+            p += (*p == '\\') ? 2 : 1;
+        }
+        if(p >= end)
+        {
+            return NULL;
+        }
+        if(((size_t)(p - key) == 6u) && (memcmp(key, "blocks", 6) == 0))
+        {
+            const unsigned char *q = p + 1;
+
+            if(take(&q, end, ':') && take(&q, end, '{'))
+            {
+                return q;
+            }
+        }
+        p++;
+    }
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * Parses a JSON dump of the Proxmark3. Its "blocks" object maps the block
+ * numbers to 32 hex digits each, missing blocks are zero. Returns NULL or
+ * the position of the error.
+ *****************************************************************************/
+static const unsigned char *parse_pm3_json(const unsigned char *text,
+                                           const unsigned char *end,
+                                           unsigned char *dump, size_t *size)
+{
+    const unsigned char *p = find_json_blocks(text, end);
+    unsigned blocks = 0;
+
+    if(p == NULL)
+    {
+        return end;
+    }
+    memset(dump, 0, MFD_MAX_DUMP_SIZE);
+
+    if(!take(&p, end, '}'))
+    {
+        do
+        {
+            unsigned block;
+
+            if(!take(&p, end, '"') || !take_block(&p, end, &block) ||
+               !take(&p, end, '"') || !take(&p, end, ':') ||
+               !take(&p, end, '"'))
+            {
+                return p;
+            }
+            if(decode_hex(&dump[block * MFD_BLOCK_SIZE], p,
+                          min_size(MFD_BLOCK_SIZE,
+                                   (size_t)(end - p) / 2u)) != MFD_BLOCK_SIZE)
+            {
+                return p;
+            }
+            p += 2u * MFD_BLOCK_SIZE;
+            if(!take(&p, end, '"'))
+            {
+                return p;
+            }
+            if(block >= blocks)
+            {
+                blocks = block + 1u;
+            }
+        }
+        while(take(&p, end, ','));
+
+        if(!take(&p, end, '}'))
+        {
+            return p;
+        }
+    }
+    *size = blocks * MFD_BLOCK_SIZE;
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * Parses one "Block N: XX XX ..." line of a Flipper dump. Unknown bytes
+ * written as ?? are zero. Returns NULL or the position of the error.
+ *****************************************************************************/
+static const unsigned char *parse_flipper_block(const unsigned char *p,
+                                                const unsigned char *eol,
+                                                unsigned char *dump,
+                                                unsigned *block)
+{
+    unsigned char *dst;
+    unsigned i;
+
+    p = skip_blank(p, eol);
+    if(!take_block(&p, eol, block) || (p >= eol) || (*p++ != ':'))
+    {
+        return p;
+    }
+
+    dst = &dump[*block * MFD_BLOCK_SIZE];
+    for(i = 0; i < MFD_BLOCK_SIZE; i++)
+    {
+        p = skip_blank(p, eol);
+        if(eol - p < 2)
+        {
+            return p;
+        }
+        if((p[0] == '?') && (p[1] == '?'))
+        {
+            dst[i] = 0;
+        }
+        else if(decode_hex(&dst[i], p, 1) != 1)
+        {
+            return p;
+        }
+        p += 2;
+    }
+    p = skip_blank(p, eol);
+
+    return (p < eol) ? p : NULL;
+}
+
+/**************************************************************************//**
+ * Parses a Flipper Zero .nfc file of a Mifare Classic card. The blocks are
+ * given by "Block N:" lines, the size of the card by the type line, the
+ * other lines are skipped. Returns NULL or the position of the error.
+ *****************************************************************************/
+static const unsigned char *parse_flipper(const unsigned char *p,
+                                          const unsigned char *end,
+                                          unsigned char *dump, size_t *size)
+{
+    size_t card_size = 0;
+    unsigned blocks = 0;
+
+    memset(dump, 0, MFD_MAX_DUMP_SIZE);
+
+    while(p < end)
+    {
+        const unsigned char *eol = line_end(p, end);
+
+        if(starts_with(p, eol, "Device type:"))
+        {
+            p = skip_blank(p + strlen("Device type:"), eol);
+            if(!starts_with(p, eol, "Mifare Classic"))
+            {
+                return p;
+            }
+        }
+        else if(starts_with(p, eol, "Mifare Classic type:"))
+        {
+            p = skip_blank(p + strlen("Mifare Classic type:"), eol);
+            if(starts_with(p, eol, "MINI"))
+            {
+                card_size = 320u;
+            }
+            else if(starts_with(p, eol, "1K"))
+            {
+                card_size = 1024u;
+            }
+            else if(starts_with(p, eol, "4K"))
+            {
+                card_size = 4096u;
+            }
+            else
+            {
+                return p;
+            }
+        }
+        else if(starts_with(p, eol, "Block "))
+        {
+            unsigned block;
+            const unsigned char *error = parse_flipper_block(p + 6, eol,
+                                                             dump, &block);
+
+            if(error != NULL)
+            {
+                return error;
+            }
+            if((card_size > 0) && (block * MFD_BLOCK_SIZE >= card_size))
+            {
+                return p;
+            }
+            if(block >= blocks)
+            {
+                blocks = block + 1u;
+            }
+        }
+        p = (eol < end) ? eol + 1 : end;
+    }
+    *size = (card_size > 0) ? card_size : blocks * MFD_BLOCK_SIZE;
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * Checks whether the first line of hex text, comments and empty lines
+ * skipped, holds nothing but hex digits and separators.
+ *****************************************************************************/
+static bool looks_like_hex(const unsigned char *p, const unsigned char *end)
+{
+    for(;;)
+    {
+        const unsigned char *eol;
+        size_t digits = 0;
+
+        p = skip_space(p, end);
+        if(p >= end)
+        {
+            return false;
+        }
+        eol = line_end(p, end);
+        if(*p != '#')
+        {
+            for(; (p < eol) && (*p != '#'); p++)
+            {
+                if(hex_values[*p] != XX)
+                {
+                    digits++;
+                }
+                else if((*p != ' ') && (*p != '\t') && (*p != '\r') &&
+                        (*p != ':'))
+                {
+                    return false;
+                }
+            }
+
+            return digits >= 2u;
+        }
+        p = eol;
+    }
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Tells the text format of the dump by its start, the first line is enough.
+ * Returns IMPORT_NONE for anything else, like binary dumps.
+ *****************************************************************************/
+int import_detect(const unsigned char *text, size_t len)
+{
+    const unsigned char *end = &text[len];
+    const unsigned char *p = skip_space(skip_bom(text, end), end);
+
+    if(starts_with(p, end, FLIPPER_HEADER))
+    {
+        return IMPORT_FLIPPER;
+    }
+    if((p < end) && (*p == '{'))
+    {
+        return IMPORT_PM3_JSON;
+    }
+    if(looks_like_hex(p, end))
+    {
+        return IMPORT_HEX;
+    }
+
+    return IMPORT_NONE;
+}
+
+/**************************************************************************//**
+ * Returns the name of the format told by import_detect().
+ *****************************************************************************/
+const char *import_name(int kind)
+{
+    if((kind < 0) || ((size_t)kind >= sizeof(import_names) /
+                                       sizeof(import_names[0])))
+    {
+        return "unknown";
+    }
+
+    return import_names[kind];
+}
+
+/**************************************************************************//**
+ * Converts the text dump of the kind to the binary layout in dump, a buffer
+ * of MFD_MAX_DUMP_SIZE bytes, and stores its size. The size is not checked
+ * against the cards, that is left to the decoder. Returns 0 on success or -1
+ * with the number of the line with the error.
+ *****************************************************************************/
+int import_parse(int kind, const unsigned char *text, size_t len,
+                 unsigned char *dump, size_t *size, unsigned long *line)
+{
+    const unsigned char *end = &text[len];
+    const unsigned char *p = skip_bom(text, end);
+    const unsigned char *error;
+
+    switch(kind)
+    {
+    case IMPORT_HEX:
+        error = parse_hex(p, end, dump, size);
+        break;
+    case IMPORT_PM3_JSON:
+        error = parse_pm3_json(p, end, dump, size);
+        break;
+    case IMPORT_FLIPPER:
+        error = parse_flipper(p, end, dump, size);
+        break;
+    default:
+        error = p;
+        break;
+    }
+
+    if(error != NULL)
+    {
+        *line = line_of(text, error);
+        return -1;
+    }
+
+    return 0;
+}
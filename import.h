@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Dumps saved as text by other tools: hex text like the .eml files of the
+ * Proxmark3, the JSON dumps of the Proxmark3 and the .nfc files of the
+ * Flipper Zero. They are converted to the binary layout of the card, so the
+ * rest of the program never sees the text.
+ *****************************************************************************/
+#ifndef IMPORT_H
+#define IMPORT_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stddef.h>
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* formats told by import_detect() */
+#define IMPORT_NONE         0
+#define IMPORT_HEX          1
+#define IMPORT_PM3_JSON     2
+#define IMPORT_FLIPPER      3
+
+/* the biggest text dump read, a 4k dump with comments takes some 30 kB */
+#define IMPORT_MAX_SIZE     (256u * 1024u)
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int import_detect(const unsigned char *text, size_t len);
+const char *import_name(int kind);
+int import_parse(int kind, const unsigned char *text, size_t len,
+                 unsigned char *dump, size_t *size, unsigned long *line);
+
+#endif /* IMPORT_H */
@@ -0,0 +1,652 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Index of the keys used by a corpus of dumps
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "index.h"
+#include "replace.h"
+#ifndef _WIN32
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+#define INDEX_BYTE_ORDER    0x01020304u
+#define INDEX_MIN_SLOTS     16u
+#define INDEX_ENTRIES_INITIAL   4096u
+#define INDEX_DUMPS_INITIAL     256u
+#define INDEX_NAMES_INITIAL     (64u * 1024u)
+
+/**************************************************************************//**
+ *                          PRIVATE VARIABLES
+ *****************************************************************************/
+static const char index_magic[8] = { 'M', 'F', 'D', 'I', 'D', 'X', 0, 1 };
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Returns the first slot of the hash table probed for the key.
+ *****************************************************************************/
+static uint32_t key_slot(uint64_t key, uint32_t mask)
+{
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+/**************************************************************************//**
+ * Orders the uses of the keys by the key, key A before key B, then by the
+ * dump and the sector.
+ *****************************************************************************/
+static int compare_entries(const void *a, const void *b)
+{
+    const struct index_entry *ea = a;
+    const struct index_entry *eb = b;
+
+    if(ea->key != eb->key)
+    {
+        return (ea->key < eb->key) ? -1 : 1;
+    }
+    if(ea->which != eb->which)
+    {
+        return (ea->which < eb->which) ? -1 : 1;
+    }
+    if(ea->dump != eb->dump)
+    {
+        return (ea->dump < eb->dump) ? -1 : 1;
+    }
+
+    return (int)ea->sector - (int)eb->sector;
+}
+
+/**************************************************************************//**
+ * Makes room for count more items in the array of item_size bytes long items.
+ *****************************************************************************/
+static int grow(void **array, size_t *capacity, size_t used, size_t count,
+                size_t initial, size_t item_size)
+{
+    if(used + count > *capacity)
+    {
+        size_t new_capacity = *capacity ? *capacity : initial;
+        void *p;
+
+        while(used + count > new_capacity)
+        {
+            new_capacity *= 2u;
+        }
+        p = realloc(*array, new_capacity * item_size);
+        if(p == NULL)
+        {
+            return -1;
+        }
+        *array = p;
+        *capacity = new_capacity;
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Checks that all the parts of the index file fit to its size and all the
+ * references point inside of it, so the queries need no more checks.
+ *****************************************************************************/
+static int index_check(struct index_map *idx, const unsigned char *data)
+{
+    const struct index_header *h = (const struct index_header *)data;
+    uint64_t left;
+    uint32_t keys = 0;
+    uint32_t i;
+
+    if((idx->size < sizeof(*h)) ||
+       (memcmp(h->magic, index_magic, sizeof(index_magic)) != 0) ||
+       (h->byte_order != INDEX_BYTE_ORDER) ||
+       (h->slots == 0) || ((h->slots & (h->slots - 1u)) != 0) ||
+       (h->keys >= h->slots))
+    {
+        return -1;
+    }
+
+    /* every part is bounded by the bytes left before it is added, so no
+       count of a damaged header can wrap the sum around */
+    left = idx->size - sizeof(*h);
+    if((h->slots > left / sizeof(struct index_slot)) ||
+       (h->postings > UINT32_MAX))
+    {
+        return -1;
+    }
+    left -= (uint64_t)h->slots * sizeof(struct index_slot);
+    if(h->postings > left / sizeof(struct index_posting))
+    {
+        return -1;
+    }
+    left -= h->postings * sizeof(struct index_posting);
+    if(h->dumps > left / sizeof(uint32_t))
+    {
+        return -1;
+    }
+    left -= (uint64_t)h->dumps * sizeof(uint32_t);
+    if((h->names_size != left) ||
+       ((h->names_size > 0) && (data[idx->size - 1u] != '\0')))
+    {
+        return -1;
+    }
+
+    idx->header = h;
+    idx->slots = (const struct index_slot *)&data[sizeof(*h)];
+    idx->postings = (const struct index_posting *)&idx->slots[h->slots];
+    idx->name_offsets = (const uint32_t *)&idx->postings[h->postings];
+    idx->names = (const char *)&idx->name_offsets[h->dumps];
+
+    for(i = 0; i < h->slots; i++)
+    {
+        const struct index_slot *slot = &idx->slots[i];
+
+        if(slot->key == MFD_KEY_NONE)
+        {
+            continue;
+        }
+        if((uint64_t)slot->first + slot->count_a + slot->count_b >
+           h->postings)
+        {
+            return -1;
+        }
+        keys++;
+    }
+    /* index_find() stops at an empty slot, so one must be left */
+    if((keys != h->keys) || (keys >= h->slots))
+    {
+        return -1;
+    }
+    for(i = 0; i < h->dumps; i++)
+    {
+        if(idx->name_offsets[i] >= h->names_size)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Adds the name of the next dump to the index being built and makes room for
+ * its entries. Returns -1 on out of memory.
+ *****************************************************************************/
+static int add_name(struct index_builder *builder, const char *name,
+                    size_t entries)
+{
+    size_t name_len = strlen(name) + 1u;
+
+    if((builder->dumps == UINT32_MAX) ||
+       (builder->names_len + name_len > UINT32_MAX) ||
+       (grow((void **)&builder->name_offsets, &builder->dumps_capacity,
+             builder->dumps, 1u, INDEX_DUMPS_INITIAL, sizeof(uint32_t)) != 0) ||
+       (grow((void **)&builder->names, &builder->names_capacity,
+             builder->names_len, name_len, INDEX_NAMES_INITIAL, 1u) != 0) ||
+       (grow((void **)&builder->entries, &builder->capacity, builder->count,
+             entries, INDEX_ENTRIES_INITIAL,
+             sizeof(struct index_entry)) != 0))
+    {
+        return -1;
+    }
+
+    builder->name_offsets[builder->dumps] = (uint32_t)builder->names_len;
+    memcpy(&builder->names[builder->names_len], name, name_len);
+    builder->names_len += name_len;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Adds the name of the dump and its keys A and B of all the sectors to the
+ * index being built. Returns -1 on out of memory.
+ *****************************************************************************/
+int index_add_dump(struct index_builder *builder, const char *name,
+                   const struct mfd_dump *info)
+{
+    unsigned sector;
+
+    if(add_name(builder, name, 2u * info->sectors) != 0)
+    {
+        return -1;
+    }
+
+    for(sector = 0; sector < info->sectors; sector++)
+    {
+        const uint8_t *trailer = &info->data[info->sector[sector].trailer];
+        struct index_entry *e = &builder->entries[builder->count];
+
+        e[0].key = mfd_key48(&trailer[0]);
+        e[0].dump = builder->dumps;
+        e[0].sector = (uint8_t)sector;
+        e[0].which = MFD_KEY_A;
+        e[1].key = mfd_key48(&trailer[10]);
+        e[1].dump = builder->dumps;
+        e[1].sector = (uint8_t)sector;
+        e[1].which = MFD_KEY_B;
+        builder->count += 2u;
+    }
+    builder->dumps++;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Adds the dumps of an opened index accepted by keep, with all their keys, to
+ * the index being built, so the index of a corpus can be updated by parsing
+ * only its new dumps. Returns -1 on out of memory.
+ *****************************************************************************/
+int index_add_index(struct index_builder *builder, const struct index_map *idx,
+                    bool (*keep)(void *ctx, const char *name), void *ctx)
+{
+    uint32_t dumps = idx->header->dumps;
+    uint32_t *ids;
+    uint32_t i;
+    int r = 0;
+
+    /* the kept dumps are numbered again, the dropped ones get UINT32_MAX */
+    ids = malloc(((dumps > 0) ? dumps : 1u) * sizeof(uint32_t));
+    if(ids == NULL)
+    {
+        return -1;
+    }
+    for(i = 0; (i < dumps) && (r == 0); i++)
+    {
+        const char *name = index_dump_name(idx, i);
+
+        ids[i] = UINT32_MAX;
+        if(keep(ctx, name))
+        {
+            r = add_name(builder, name, 0);
+            ids[i] = builder->dumps++;
+        }
+    }
+
+    for(i = 0; (i < idx->header->slots) && (r == 0); i++)
+    {
+        const struct index_slot *slot = &idx->slots[i];
+        uint32_t end = slot->first + slot->count_a + slot->count_b;
+        uint32_t p;
+
+        if(slot->key == MFD_KEY_NONE)
+        {
+            continue;
+        }
+        for(p = slot->first; p < end; p++)
+        {
+            const struct index_posting *post = &idx->postings[p];
+            struct index_entry *e;
+
+            if((post->dump >= dumps) || (ids[post->dump] == UINT32_MAX))
+            {
+                continue;
+            }
+            if(grow((void **)&builder->entries, &builder->capacity,
+                    builder->count, 1u, INDEX_ENTRIES_INITIAL,
+                    sizeof(struct index_entry)) != 0)
+            {
+                r = -1;
+                break;
+            }
+            e = &builder->entries[builder->count++];
+            e->key = slot->key;
+            e->dump = ids[post->dump];
+            e->sector = post->sector;
+            e->which = post->which;
+        }
+    }
+    free(ids);
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Sorts the collected keys and writes the index file. Returns -1 and sets
+ * errno on failure.
+ *****************************************************************************/
+int index_write(struct index_builder *builder, const char *path)
+{
+    struct index_header h;
+    struct index_slot *slots;
+    struct index_posting *postings;
+    uint32_t slot_count = INDEX_MIN_SLOTS;
+    uint32_t keys = 0;
+    size_t i;
+    char *tmp_path;
+    FILE *fp;
+    int r = 0;
+
+    if(builder->count > UINT32_MAX)
+    {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    qsort(builder->entries, builder->count, sizeof(struct index_entry),
+          compare_entries);
+    for(i = 0; i < builder->count; i++)
+    {
+        if((i == 0) || (builder->entries[i].key != builder->entries[i - 1u].key))
+        {
+            keys++;
+        }
+    }
+    /* at most half of the slots is used to keep the probe sequences short */
+    while(slot_count < 2u * (uint64_t)keys)
+    {
+        slot_count *= 2u;
+    }
+
+    slots = malloc(slot_count * sizeof(*slots));
+    postings = malloc((builder->count ? builder->count : 1u) *
+                      sizeof(*postings));
+    if((slots == NULL) || (postings == NULL))
+    {
+        free(slots);
+        free(postings);
+        errno = ENOMEM;
+        return -1;
+    }
+    for(i = 0; i < slot_count; i++)
+    {
+        slots[i].key = MFD_KEY_NONE;
+        slots[i].first = 0;
+        slots[i].count_a = 0;
+        slots[i].count_b = 0;
+        slots[i].reserved = 0;
+    }
+
+    for(i = 0; i < builder->count; )
+    {
+        const struct index_entry *e = &builder->entries[i];
+        uint32_t s = key_slot(e->key, slot_count - 1u);
+        struct index_slot *slot;
+
+        while(slots[s].key != MFD_KEY_NONE)
+        {
+            s = (s + 1u) & (slot_count - 1u);
+        }
+        slot = &slots[s];
+        slot->key = e->key;
+        slot->first = (uint32_t)i;
+        for(; (i < builder->count) && (builder->entries[i].key == slot->key); i++)
+        {
+            e = &builder->entries[i];
+            postings[i].dump = e->dump;
+            postings[i].sector = e->sector;
+            postings[i].which = e->which;
+            postings[i].reserved = 0;
+            if(e->which == MFD_KEY_A)
+            {
+                slot->count_a++;
+            }
+            else
+            {
+                slot->count_b++;
+            }
+        }
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, index_magic, sizeof(index_magic));
+    h.byte_order = INDEX_BYTE_ORDER;
+    h.dumps = builder->dumps;
+    h.keys = keys;
+    h.slots = slot_count;
+    h.postings = builder->count;
+    h.names_size = builder->names_len;
+
+    fp = replace_open(path, &tmp_path);
+    if(fp == NULL)
+    {
+        r = -1;
+    }
+    else
+    {
+        if((fwrite(&h, sizeof(h), 1, fp) != 1) ||
+           (fwrite(slots, sizeof(*slots), slot_count, fp) != slot_count) ||
+           (fwrite(postings, sizeof(*postings), builder->count, fp) !=
+            builder->count) ||
+           (fwrite(builder->name_offsets, sizeof(uint32_t), builder->dumps, fp) !=
+            builder->dumps) ||
+           (fwrite(builder->names, 1, builder->names_len, fp) !=
+            builder->names_len))
+        {
+            r = -1;
+        }
+        r = replace_close(fp, path, tmp_path, r);
+    }
+
+    free(slots);
+    free(postings);
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Releases the keys and names collected by the builder.
+ *****************************************************************************/
+void index_free(struct index_builder *builder)
+{
+    free(builder->entries);
+    free(builder->name_offsets);
+    free(builder->names);
+    memset(builder, 0, sizeof(*builder));
+}
+
+/**************************************************************************//**
+ * Maps the index file to memory for queries. Returns -1 and sets errno on
+ * failure, EINVAL if the file is not a valid index.
+ *****************************************************************************/
+int index_open(const char *path, struct index_map *idx)
+{
+    const unsigned char *data;
+#ifndef _WIN32
+    struct stat st;
+    int fd;
+#else
+    FILE *fp;
+    long size;
+#endif
+
+    memset(idx, 0, sizeof(*idx));
+
+#ifndef _WIN32
+    fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    if((st.st_size < (off_t)sizeof(struct index_header)))
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    idx->size = (size_t)st.st_size;
+    idx->map = mmap(NULL, idx->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(idx->map == MAP_FAILED)
+    {
+        idx->map = NULL;
+        return -1;
+    }
+    data = idx->map;
+#else
+    fp = fopen(path, "rb");
+    if(fp == NULL)
+    {
+        return -1;
+    }
+    if((fseek(fp, 0, SEEK_END) != 0) || ((size = ftell(fp)) < 0) ||
+       (fseek(fp, 0, SEEK_SET) != 0))
+    {
+        fclose(fp);
+        return -1;
+    }
+    idx->size = (size_t)size;
+    idx->buffer = malloc(idx->size ? idx->size : 1u);
+    if((idx->buffer == NULL) ||
+       (fread(idx->buffer, 1, idx->size, fp) != idx->size))
+    {
+        fclose(fp);
+        index_close(idx);
+        errno = EIO;
+        return -1;
+    }
+    fclose(fp);
+    data = idx->buffer;
+#endif
+
+    if(index_check(idx, data) != 0)
+    {
+        index_close(idx);
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Unmaps the index file.
+ *****************************************************************************/
+void index_close(struct index_map *idx)
+{
+#ifndef _WIN32
+    if(idx->map != NULL)
+    {
+        munmap(idx->map, idx->size);
+    }
+#endif
+    free(idx->buffer);
+    memset(idx, 0, sizeof(*idx));
+}
+
+/**************************************************************************//**
+ * Looks the key up in the hash table. Returns its slot or NULL if no dump
+ * uses the key.
+ *****************************************************************************/
+const struct index_slot *index_find(const struct index_map *idx, uint64_t key)
+{
+    uint32_t mask = idx->header->slots - 1u;
+    uint32_t s = key_slot(key, mask);
+
+    if(key == MFD_KEY_NONE)
+    {
+        return NULL;
+    }
+
+    /* the table is never full, every probe sequence ends by an empty slot */
+    while(idx->slots[s].key != MFD_KEY_NONE)
+    {
+        if(idx->slots[s].key == key)
+        {
+            return &idx->slots[s];
+        }
+        s = (s + 1u) & mask;
+    }
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * Returns the name of the dump referenced by a posting.
+ *****************************************************************************/
+const char *index_dump_name(const struct index_map *idx, uint32_t dump)
+{
+    if(dump >= idx->header->dumps)
+    {
+        return "?";
+    }
+
+    return &idx->names[idx->name_offsets[dump]];
+}
+
+/**************************************************************************//**
+ * Finds up to k keys used by the most sectors, as key A or key B. The keys
+ * are stored to top ordered by the number of uses, the same counts by the
+ * key. Returns the number of keys found.
+ *****************************************************************************/
+size_t index_top(const struct index_map *idx,
+                 const struct index_slot **top, size_t k)
+{
+    size_t found = 0;
+    uint32_t i;
+
+    for(i = 0; i < idx->header->slots; i++)
+    {
+        const struct index_slot *slot = &idx->slots[i];
+        uint64_t uses = (uint64_t)slot->count_a + slot->count_b;
+        size_t pos;
+
+        if(slot->key == MFD_KEY_NONE)
+        {
+            continue;
+        }
+
+        /* insertion to the short sorted list of the best keys */
+        pos = found;
+        while(pos > 0)
+        {
+            const struct index_slot *prev = top[pos - 1u];
+            uint64_t prev_uses = (uint64_t)prev->count_a + prev->count_b;
+
+            if((prev_uses > uses) ||
+               ((prev_uses == uses) && (prev->key < slot->key)))
+            {
+                break;
+            }
+            if(pos < k)
+            {
+                top[pos] = prev;
+            }
+            pos--;
+        }
+        if(pos < k)
+        {
+            top[pos] = slot;
+            if(found < k)
+            {
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Index of the keys used by a corpus of dumps. The index is built once from
+ * all the dumps and written to a file, which is then mapped to memory and
+ * queried without parsing the dumps again.
+ *****************************************************************************/
+#ifndef INDEX_H
+#define INDEX_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mfd.h"
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* one use of a key collected while the index is built */
+struct index_entry
+{
+    uint64_t key;
+    uint32_t dump;
+    uint8_t sector;
+    uint8_t which;              /* MFD_KEY_A or MFD_KEY_B */
+};
+
+/* keys and names of the dumps collected before the index is written */
+struct index_builder
+{
+    struct index_entry *entries;
+    size_t count;
+    size_t capacity;
+    uint32_t *name_offsets;
+    uint32_t dumps;
+    size_t dumps_capacity;
+    char *names;
+    size_t names_len;
+    size_t names_capacity;
+};
+
+/* Layout of the index file, all numbers are in the byte order of the host
+   which has written it:
+     header
+     slots[slots]           open addressing hash table of the distinct keys
+     postings[postings]     uses of the keys, grouped by the key
+     name_offsets[dumps]    offsets of the names of the dumps in names
+     names[names_size]      NUL terminated names of the dumps */
+struct index_header
+{
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t dumps;
+    uint32_t keys;
+    uint32_t slots;             /* power of two */
+    uint64_t postings;
+    uint64_t names_size;
+};
+
+/* a distinct key and the range of its postings, empty slots have the key
+   MFD_KEY_NONE */
+struct index_slot
+{
+    uint64_t key;
+    uint32_t first;
+    uint32_t count_a;           /* postings of key A come first */
+    uint32_t count_b;
+    uint32_t reserved;
+};
+
+/* one sector using the key */
+struct index_posting
+{
+    uint32_t dump;
+    uint8_t sector;
+    uint8_t which;
+    uint16_t reserved;
+};
+
+/* index file opened for queries */
+struct index_map
+{
+    const struct index_header *header;
+    const struct index_slot *slots;
+    const struct index_posting *postings;
+    const uint32_t *name_offsets;
+    const char *names;
+    void *map;
+    void *buffer;
+    size_t size;
+};
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int index_add_dump(struct index_builder *builder, const char *name,
+                   const struct mfd_dump *info);
+int index_add_index(struct index_builder *builder, const struct index_map *idx,
+                    bool (*keep)(void *ctx, const char *name), void *ctx);
+int index_write(struct index_builder *builder, const char *path);
+void index_free(struct index_builder *builder);
+
+int index_open(const char *path, struct index_map *idx);
+void index_close(struct index_map *idx);
+const struct index_slot *index_find(const struct index_map *idx,
+                                    uint64_t key);
+const char *index_dump_name(const struct index_map *idx, uint32_t dump);
+size_t index_top(const struct index_map *idx,
+                 const struct index_slot **top, size_t k);
+
+#endif /* INDEX_H */
@@ -24,16 +24,42 @@
 /**************************************************************************//**
  * INCLUDE FILES: Header files of modules referenced by this module
  *****************************************************************************/
-#include <ctype.h>
+/* realpath() is an X/Open extension of POSIX */
+#define _XOPEN_SOURCE 700
+
+#include <dirent.h>
+#include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <sys/stat.h>
+#include "archive.h"
+#include "audit.h"
+#include "cache.h"
+#include "format.h"
+#include "import.h"
+#include "index.h"
+#include "manifest.h"
+#include "match.h"
+#include "policy.h"
+#include "ranges.h"
+#include "serve.h"
+#include "stats.h"
+#include "uring.h"
+#include "mfd.h"
 #include "version.h"
 #ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
 #   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <unistd.h>
 #endif
 
 /**************************************************************************//**
@@ -42,16 +68,142 @@
 #define OPT_LONG_HELP       0x100
 #define OPT_VERBOSE         0x101
 #define OPT_VERSION         0x102
+#define OPT_STREAM          0x103
+#define OPT_FORMAT          0x104
+#define OPT_BUILD_INDEX     0x105
+#define OPT_INDEX           0x106
+#define OPT_KEY             0x107
+#define OPT_TOP             0x108
+#define OPT_CACHE           0x109
+#define OPT_DIFF            0x10a
+#define OPT_VALUES_ONLY     0x10b
+#define OPT_SECTORS         0x10c
+#define OPT_BLOCKS          0x10d
+#define OPT_AUDIT           0x10e
+#define OPT_POLICY          0x10f
+#define OPT_SERVE           0x110
+#define OPT_MATCH           0x111
+#define OPT_MANIFEST        0x112
+#define OPT_SERVE_ROOT      0x113
+
+/* smallest file parsed from a memory mapping */
+#define MMAP_MIN_SIZE       (64 * 1024)
+/* longest name of a dump shown in the header */
+#define PATH_NAME_MAX       4096u
+
+/* initial capacity of the list of input files */
+#define INPUT_LIST_INITIAL  64u
+/* stdout buffer used in the batch mode */
+#define BATCH_STDOUT_BUFFER (1024u * 1024u)
+/* parsed dumps waiting for the writer per worker thread */
+#define BATCH_SLOTS_PER_THREAD  4u
+#define MAX_JOBS            256u
+/* files read by io_uring at once in the sequential batch mode */
+#define URING_DEPTH         256u
+/* exit status of --diff, the same as of diff(1) */
+#define DIFF_SAME           0
+#define DIFF_CHANGED        1
+#define DIFF_TROUBLE        2
+/* most keys listed by --top */
+#define MAX_TOP_KEYS        10000u
+
+/* sectors of the biggest card and blocks of its biggest sector, the limits
+   of --sectors and --blocks */
+#define MAX_SECTORS         40u
+#define MAX_BLOCKS          16u
+
+/**************************************************************************//**
+ *                              PRIVATE TYPES
+ *****************************************************************************/
+/* statistics of one parsed dump reported in the batch summary line */
+struct dump_stats
+{
+    unsigned data_size;
+    int sectors;
+    unsigned access_errors;
+    unsigned at_risk;           /* sectors using keys of the audit dictionary */
+    unsigned risky_dumps;
+    unsigned violations;        /* sectors breaking rules of the policy */
+    unsigned violating_dumps;
+    unsigned matched;           /* dumps passing the --match filter */
+};
+
+/* everything one dump writes to stdout and stderr */
+struct dump_result
+{
+    struct dump_stats stats;
+    struct output out;
+    struct output err;
+};
+
+/* content of one input file */
+struct dump_source
+{
+    const unsigned char *data;
+    size_t size;
+    void *map;
+    int archive;                /* kind of the archive, not read yet */
+    unsigned char *buffer;
+};
 
-#define ANSI_CTRL_RESET                 "\x1B[0m"
-#define ANSI_CTRL_TEXT_RED              "\x1B[0;31m"
-#define ANSI_CTRL_TEXT_GREEN            "\x1B[0;32m"
-#define ANSI_CTRL_TEXT_BLUE             "\x1B[0;34m"
-#define ANSI_CTRL_TEXT_BOLD_INTENSIV_YELLOW  "\x1B[1;93m"
+/* list of dump files to be processed in a single run */
+struct input_list
+{
+    char **paths;
+    size_t count;
+    size_t capacity;
+};
+
+/* directory being scanned, linked to the one it has been found in */
+struct scan_dir
+{
+    dev_t dev;
+    ino_t ino;
+    const struct scan_dir *parent;
+};
+
+/* parsed dump waiting in the queue for the writer */
+struct batch_slot
+{
+    struct dump_result res;
+    int status;
+    bool ready;
+};
+
+/* members of an archive being parsed */
+struct archive_scan
+{
+    struct dump_result *res;
+    bool flush;                 /* write every member as soon as parsed */
+};
+
+/* state of the sequential scan of the files read by io_uring */
+struct uring_scan
+{
+    struct input_list *inputs;
+    struct dump_result res;
+    unsigned failed;
+};
+
+/* queue shared by the worker threads and the writer in the batch mode */
+struct batch_queue
+{
+    struct input_list *inputs;
+    struct batch_slot *slots;
+    size_t window;
+    size_t next_job;
+    size_t written;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_ready;
+    pthread_cond_t slot_free;
+};
 
 /**************************************************************************//**
  *                    PROTOTYPES OF PRIVATE FUNCTIONS
  *****************************************************************************/
+static int add_input_path(struct input_list *list, const char *path);
+static void write_result(struct dump_result *res);
+static void free_result(struct dump_result *res);
 
 /**************************************************************************//**
  *                              PRIVATE VARIABLES
@@ -61,50 +213,79 @@ static struct option opts[] = {
     { "version", 0, 0, OPT_VERSION },
     { "verbose", 0, 0, 'v' },
     { "no-color", 0, 0, 'n' },
+    { "files-from", 1, 0, 'f' },
+    { "null", 0, 0, '0' },
+    { "jobs", 1, 0, 'j' },
+    { "size", 1, 0, 's' },
+    { "stream", 0, 0, OPT_STREAM },
+    { "compact", 0, 0, 'c' },
+    { "format", 1, 0, OPT_FORMAT },
+    { "build-index", 1, 0, OPT_BUILD_INDEX },
+    { "index", 1, 0, OPT_INDEX },
+    { "key", 1, 0, OPT_KEY },
+    { "top", 1, 0, OPT_TOP },
+    { "cache", 1, 0, OPT_CACHE },
+    { "diff", 0, 0, OPT_DIFF },
+    { "values-only", 0, 0, OPT_VALUES_ONLY },
+    { "sectors", 1, 0, OPT_SECTORS },
+    { "blocks", 1, 0, OPT_BLOCKS },
+    { "audit", 1, 0, OPT_AUDIT },
+    { "policy", 1, 0, OPT_POLICY },
+    { "serve", 1, 0, OPT_SERVE },
+    { "match", 1, 0, OPT_MATCH },
+    { "manifest", 1, 0, OPT_MANIFEST },
+    { "serve-root", 1, 0, OPT_SERVE_ROOT },
     { 0, 0, 0, 0 }
 };
 
 static const char * progname;
-static char *input_file = NULL;
+static const char *files_from = NULL;
+static char list_separator = '\n';
 static int verbose = 0;
 static bool colored = true;
 static bool force_1k = false;
-static const char * const bit_rep[8] =
-{
-    "000", "001", "010", "011", "100", "101", "110", "111"
-};
-
-static const char * const permission_trailer[8] =
-{
-    "- A | A   - | A A",
-    "- A | A   A | A A [transport]",
-    "- - | A   - | A -",
-    "- B | A/B B | - B",
-    "- B | A/B - | - B",
-    "- - | A/B B | - -",
-    "- - | A/B - | - -",
-    "- - | A/B - | - -",
-};
-
-static const char * const permission_data[8] =
-{
-    "A/B | A/B   | A/B | A/B [transport]",
-    "A/B |  -    |  -  | A/B [value]",
-    "A/B |  -    |  -  |  -  [r/w]",
-    "  B |   B   |  -  |  -  [r/w]",
-    "A/B |   B   |  -  |  -  [r/w]",
-    "  B |  -    |  -  |  -  [r/w]",
-    "A/B |   B   |   B | A/B [value]",
-    " -  |  -    |  -  |  -  [r/w]",
-};
+static bool batch = false;
+static unsigned jobs = 1;
+static size_t pack_size = 0;
+static bool stream = false;
+static struct format_options fmt = { FORMAT_TEXT, false, false, false,
+                                     &palette_ansi,
+                                     FORMAT_ALL_SECTORS, FORMAT_ALL_BLOCKS };
+static unsigned long json_items = 0;
+static const char *build_index = NULL;
+static struct index_builder index_builder;
+static const char *index_path = NULL;
+static const char *query_key = NULL;
+static unsigned long top_keys = 0;
+static const char *cache_path = NULL;
+static struct dump_cache cache;
+static bool diff = false;
+static struct run_stats run_stats;
+static const char *audit_path = NULL;
+static struct key_set audit_keys;
+static unsigned long audit_sectors = 0;
+static unsigned long audit_dumps = 0;
+static const char *policy_path = NULL;
+static struct policy policy;
+static unsigned long policy_violations = 0;
+static unsigned long policy_dumps = 0;
+static const char *serve_path = NULL;
+/* resolved directory whose files --serve may open, none without it */
+static char *serve_root = NULL;
+static struct match matches;
+static unsigned long matched_dumps = 0;
+static const char *manifest_path = NULL;
+static struct manifest manifest;
+/* the index written by the last run, the dumps of the unchanged files are
+   taken from it */
+static struct index_map last_index;
+static bool last_index_open = false;
+/* the files are parsed by the writer, so the output can be written early */
+static bool sequential = false;
+/* innermost directory being scanned, to break the loops of symbolic links */
+static const struct scan_dir *scan_dirs = NULL;
 
-static const char *empty_string = "";
 
-static const char *color_keyB = ANSI_CTRL_TEXT_BLUE;
-static const char *color_keyA = ANSI_CTRL_TEXT_RED;
-static const char *color_access = ANSI_CTRL_TEXT_GREEN;
-static const char *color_warning = ANSI_CTRL_TEXT_BOLD_INTENSIV_YELLOW;
-static const char *color_default = ANSI_CTRL_RESET;
 
 /**************************************************************************
  Output the command-line options for this daemon.
@@ -112,16 +293,43 @@ static const char *color_default = ANSI_CTRL_RESET;
 static void print_help(void)
 {
     printf("\
-Usage: %s [OPTION] <FILE>\n\
-Parse Mifare dump FILE and show details.\
+Usage: %s [OPTION] <FILE|DIR>...\n\
+  or:  %s --diff <FILE1 FILE2|DIR1 DIR2>\n\
+Parse Mifare dump FILEs and show details.\n\
+Directories are scanned recursively, FILE '-' reads a dump from stdin.\n\
+Dumps may be binary, hex text (.eml), Proxmark3 JSON or Flipper .nfc files.\n\
 \n\
 Options:\n\
  -h, --help      : Print this help message\n\
      --version   : Print the version number and exit\n\
- -v, --verbose   : Print verbose debug statements\n\
- -1             : Force 1k format\n\
- -n, --no-color  : Do not colorize the output\n"
-           , progname);
+ -v, --verbose   : Print timings of the stages, -vv also per dump percentiles\n\
+ -1             : Force 1k format, the 1st kilobyte of bigger dumps is parsed\n\
+ -n, --no-color  : Do not colorize the output\n\
+ -c, --compact   : Show runs of empty sectors with default trailers as one line\n\
+     --values-only : Show only the decoded value blocks instead of the table\n\
+     --sectors=LIST : Show only the sectors of LIST, like 1-3,10\n\
+     --blocks=LIST : Show only the blocks of LIST in every sector, like 0-2\n\
+     --format=FMT : Output format: text (default), json, ndjson or binary\n\
+ -f, --files-from LIST : Read the names of dump files from LIST ('-' is stdin)\n\
+ -0, --null      : Names in LIST are separated by NUL instead of newline\n\
+ -j, --jobs N    : Parse the dumps by N threads, the output keeps the order\n\
+ -s, --size N    : Files are packs of concatenated dumps of N bytes each\n\
+     --stream    : Parse the dumps of --size bytes as they arrive (stdin default)\n\
+     --build-index=INDEX : Write the keys of all the dumps to INDEX\n\
+     --index=INDEX : Query INDEX instead of parsing dumps, with --key or --top\n\
+     --key=KEY   : List the dumps and sectors using KEY (12 hex digits)\n\
+     --top=K     : List K keys used by the most sectors\n\
+     --cache=FILE : Reuse the output of dumps seen before, kept in FILE\n\
+     --diff      : Show the blocks that differ between two dumps, or between\n\
+                   the dumps of the same names in two directories\n\
+     --audit=DICT : List only the sectors using keys of the dictionary DICT\n\
+     --policy=FILE : List only the sectors breaking the access rules of FILE\n\
+     --serve=SOCKET : Decode the dumps and files requested on a Unix socket\n\
+     --serve-root=DIR : Let the --serve clients request the files below DIR\n\
+     --match=EXPR : Show only the dumps matching EXPR, all of more must hold\n\
+     --manifest=FILE : Parse only the files changed since the run which has\n\
+                   written FILE, and update FILE\n"
+           , progname, progname);
 }
 
 /**************************************************************************
@@ -159,386 +367,2309 @@ static char *ident_from_argv0(char *argv0)
 }
 
 /**************************************************************************//**
- * Decodes the access bit string for specific block.
- * Returns the three access bits for the block or -1 if the inverted bits do
- * not match the access bits.
- *****************************************************************************/
-static int get_access_condition(unsigned sector, unsigned block,
-                                unsigned char* access_bits)
-{
-    if(sector >= 32)
-    {
-        /* Mifare 4k uses access rights in clusters of 5 blocks each for sectors
-           in a range 32 to 39. */
-        block = block / 5;
-    }
-
-    unsigned bits, inverted;
-
-    /*C1x C2x C3x access bits for block x*/
-    /*/C1x /C2x /C3x inverted access bits for block x*/
-    switch(block)
-    {
-    case 0:
-        bits = (access_bits[1] >> 2) & 0x04;    /* C10 */
-        bits |= (access_bits[2] << 1) & 0x02;   /* C20 */
-        bits |= (access_bits[2] >> 4) & 0x01;   /* C30 */
-        inverted = (access_bits[0] << 2) & 0x04;    /* /C10 */
-        inverted |= (access_bits[0] >> 3) & 0x02;   /* /C20 */
-        inverted |= (access_bits[1] >> 0) & 0x01;   /* /C30 */
-        break;
-
-    case 1:
-        bits = (access_bits[1] >> 3) & 0x04;    /* C11 */
-        bits |= (access_bits[2] << 0) & 0x02;   /* C21 */
-        bits |= (access_bits[2] >> 5) & 0x01;   /* C31 */
-        inverted = (access_bits[0] << 1) & 0x04;    /* /C11 */
-        inverted |= (access_bits[0] >> 4) & 0x02;   /* /C21 */
-        inverted |= (access_bits[1] >> 1) & 0x01;   /* /C31 */
-        break;
-
-    case 2:
-        bits = (access_bits[1] >> 4) & 0x04;    /* C12 */
-        bits |= (access_bits[2] >> 1) & 0x02;   /* C22 */
-        bits |= (access_bits[2] >> 6) & 0x01;   /* C32 */
-        inverted = (access_bits[0] << 0) & 0x04;    /* /C12 */
-        inverted |= (access_bits[0] >> 5) & 0x02;   /* /C22 */
-        inverted |= (access_bits[1] >> 2) & 0x01;   /* /C32 */
-        break;
-
-    case 3:
-        bits = (access_bits[1] >> 5) & 0x04;    /* C13 */
-        bits |= (access_bits[2] >> 2) & 0x02;   /* C23 */
-        bits |= (access_bits[2] >> 7) & 0x01;   /* C33 */
-        inverted = (access_bits[0] >> 1) & 0x04;    /* /C13 */
-        inverted |= (access_bits[0] >> 6) & 0x02;   /* /C23 */
-        inverted |= (access_bits[1] >> 3) & 0x01;   /* /C33 */
-        break;
-
-    default:
-        return -1;
+ * Returns the start time of a stage, the stages are timed by -v only.
+ *****************************************************************************/
+static uint64_t stage_start(void)
+{
+    return (verbose > 0) ? stats_now() : 0;
+}
+
+/**************************************************************************//**
+ * Adds the time of the stage started at start to the statistics.
+ *****************************************************************************/
+static void stage_end(unsigned stage, uint64_t start)
+{
+    if(verbose > 0)
+    {
+        stats_add(&run_stats, stage, stats_now() - start);
     }
+}
+
+/**************************************************************************//**
+ * Returns a number identifying the settings which change the rendered output
+ * of a dump, so the cache never mixes the outputs of different settings or
+ * versions.
+ *****************************************************************************/
+static uint32_t cache_fingerprint(void)
+{
+    return ((uint32_t)MAJOR << 24) | ((uint32_t)MINOR << 16) |
+           ((uint32_t)fmt.format) | (fmt.compact ? 0x10u : 0) |
+           ((fmt.colors == &palette_ansi) ? 0x20u : 0) |
+           (force_1k ? 0x40u : 0) | (fmt.values_only ? 0x80u : 0);
+}
 
-    if(bits != ((~inverted)&0x07))
+/**************************************************************************//**
+ * Returns a number identifying the options which change the outputs of a run,
+ * the filters, the selections and the contents of the --audit dictionary and
+ * of the --policy included, so a manifest never keeps the files whose outputs
+ * the last run has written with other options.
+ *****************************************************************************/
+static uint32_t manifest_fingerprint(void)
+{
+    struct output buf = { NULL, 0, 0 };
+    uint32_t fingerprint;
+    size_t i;
+
+    out_printf(&buf, "%lx %lx %lx %lx %x %s\n",
+               (unsigned long)cache_fingerprint(), (unsigned long)pack_size,
+               (unsigned long)(fmt.sectors >> 32),
+               (unsigned long)(fmt.sectors & 0xffffffffu),
+               (unsigned)fmt.blocks, (build_index != NULL) ? build_index : "");
+    for(i = 0; i < matches.count; i++)
     {
-        return -1;
+        const struct match_term *t = &matches.terms[i];
+
+        out_printf(&buf, "match %d %d %u %lx %lx %x %lx\n", t->field,
+                   (int)t->negate, t->card, (unsigned long)(t->sectors >> 32),
+                   (unsigned long)(t->sectors & 0xffffffffu),
+                   (unsigned)t->blocks,
+                   (unsigned long)mfd_xxh64(t->pattern, t->len));
+    }
+    if(audit_path != NULL)
+    {
+        out_printf(&buf, "audit %lx\n", (unsigned long)mfd_xxh64(
+                   (const uint8_t *)audit_keys.keys,
+                   audit_keys.count * sizeof(audit_keys.keys[0])));
+    }
+    for(i = 0; (policy_path != NULL) && (i < policy.count); i++)
+    {
+        out_printf(&buf, "policy %s\n", policy.rules[i].text);
     }
 
-    return bits;
+    fingerprint = (uint32_t)mfd_xxh64((const uint8_t *)buf.data, buf.len);
+    free(buf.data);
+
+    return fingerprint;
 }
 
 /**************************************************************************//**
- *
+ * Parses the dump and renders it in the selected output format.
  *****************************************************************************/
-static int print_info(FILE *fp)
+static int print_info(const char *name, const unsigned char *dump,
+                      size_t dump_size, struct dump_result *res)
 {
+    struct mfd_dump info;
     unsigned data_size;
-    unsigned char data[4097];
-    int sector;
-    int sectors = 0;
+    int r;
+    const unsigned char *data = dump;
+    bool cached;
+    uint64_t hash = 0;
+    size_t start;
+    uint64_t t = stage_start();
 
-    memset(data, 0, sizeof(data));
-    data_size = fread(data, sizeof(uint8_t), sizeof(data), fp);
+    /* the size is checked before any byte of the dump is touched, the data
+       of rejected files are not even read */
+    data_size = (dump_size > MFD_MAX_DUMP_SIZE) ? MFD_MAX_DUMP_SIZE + 1u
+                                                : (unsigned)dump_size;
 
     if(force_1k)
     {
-        data_size = 1024;
-    }
-
-    switch(data_size)
-    {
-    case 320u:
-        sectors = 5u;
-        break;
-    case 1024u:
-        sectors = 16u;
-        break;
-    case 2048u:
-        sectors = 32u;
-        break;
-    case 4096u:
-        sectors = 32u + 8u;
-        break;
-    default:
-        fprintf(stderr, "Wrong file size: %u bytes.\n"
-                "Only 320, 1024, 2048 or 4096 bytes is allowed.", data_size);
+        if(dump_size < 1024u)
+        {
+            out_printf(&res->err, "Dump of %lu bytes is too short for the 1k format.\n",
+                       (unsigned long)dump_size);
+            return EXIT_FAILURE;
+        }
+        /* the 1st kilobyte of a bigger dump is parsed */
+        data_size = 1024u;
+    }
+
+    if(mfd_card_sectors(data_size) == 0)
+    {
+        out_printf(&res->err, "Wrong file size: %lu bytes.\n"
+                   "Only 320, 1024, 2048 or 4096 bytes is allowed.\n",
+                   (unsigned long)dump_size);
         return EXIT_FAILURE;
     }
+    stage_end(STAGE_DETECT, t);
 
-    printf("File size: %u bytes. Expected %d sectors\n", data_size, sectors);
-    /*
-     UID 4b:
-     11223344440804006263646566676869
-     ^^^^^^^^                         UID
-             ^^                       BCC
-               ^^                     SAK(*)
-                 ^^^^                 ATQA
-                     ^^^^^^^^^^^^^^^^ Manufacturer data
-    */
-
-    /* 4bit UID */
-    printf("\tUID: %02x%02x%02x%02x\n", data[0], data[1], data[2], data[3]);
-    printf("\tBCC:  %02x\n", data[4]);
-    printf("\tSAK:  %02x\n", data[5]);
-    printf("\tATQA: %02x%02x\n", data[6], data[7]);
-
-    printf("====================================================================================================\n");
-    printf("| Sect | Blck |            Data                  | Access |  r  |  w    |  i  | d/t/r [info]       |\n");
-    printf("|      |      |                                  |  cond. |   A | Acc.  | B                        |\n");
-    printf("|      |      | %sKey A%s      %sAccess Bits%s     %sKey B%s |        | r w | r   w | r w                      |\n",
-           color_keyA, color_default, color_access,
-           color_default, color_keyB, color_default);
-    for(sector = 0; sector < sectors; sector++)
-    {
-        unsigned sector_start;
-        unsigned char *keyA, *keyB, *access_bits;
-        unsigned sector_size;
-        unsigned block;
-        unsigned blocks;
-        unsigned block_size;
-
-        if(sector < 32u)
-        {
-            blocks = 4u;
-            block_size = 16u;
-            sector_size = block_size * blocks;
-            sector_start = sector * sector_size;
-        }
-        else
+    /* only the outputs of whole dumps are cached */
+    cached = (cache_path != NULL) && (build_index == NULL) &&
+             (audit_path == NULL) && (policy_path == NULL) &&
+             (fmt.sectors == FORMAT_ALL_SECTORS) &&
+             (fmt.blocks == FORMAT_ALL_BLOCKS);
+    if(cached)
+    {
+        unsigned sectors, access_errors;
+        size_t mark = res->out.len;
+
+        hash = mfd_xxh64(data, data_size);
+        if((fmt.format == FORMAT_JSON) || (fmt.format == FORMAT_NDJSON))
         {
-            blocks = 16u;
-            block_size = 16u;
-            sector_size = block_size * blocks;
-            sector_start = 2048u + (sector - 32u) * sector_size;
+            /* only the rest of the object after the name is cached */
+            render_json_head(name, &fmt, &res->out);
         }
-        keyA = &data[sector_start + sector_size - block_size + 0];
-        keyB = &data[sector_start + sector_size - block_size + 10];
-        access_bits = &data[sector_start + sector_size - block_size + 6];
-        printf("====================================================================================================\n");
-
-        for(block = 0; block < blocks; block++)
+        r = cache_lookup(&cache, hash, cache_fingerprint(), data, data_size,
+                         &res->out, &sectors, &access_errors);
+        if(r > 0)
         {
-            unsigned i;
-            unsigned block_start = sector_start + block * block_size;
-            char str_sector[6];
-            char str_permissions[64] = {0};
-            int access_condition = get_access_condition(sector, block, access_bits);
-            char str_data_hex[64] = {0};
-            char str_data_ascii[64] = {0};
-            char str_access_bits[64]= {0};
-            int pos;
-
-            /* show sector number nexto to each 2nd block */
-            if(block == 1)
-            {
-                snprintf( str_sector, sizeof(str_sector), "%d", sector);
-            }
-            else
+            res->stats.data_size = data_size;
+            res->stats.sectors = (int)sectors;
+            res->stats.access_errors = access_errors;
+            if(verbose > 0)
             {
-                strcpy(str_sector, empty_string);
+                stats_add_dump(&run_stats, data_size, access_errors);
             }
+            return 0;
+        }
+        res->out.len = mark;
+        if(r < 0)
+        {
+            out_printf(&res->err, "Out of memory\n");
+            return EXIT_FAILURE;
+        }
+    }
 
-            /* prepare data in hex format */
-            if(block == blocks-1)
-            {
-                pos = 0;
+    /* the size has been checked, so the decoding cannot fail; the index
+       always covers whole dumps */
+    t = stage_start();
+    mfd_decode_selected(data, data_size,
+                        (build_index != NULL) ? MFD_ALL_SECTORS : fmt.sectors,
+                        &info);
+    stage_end(STAGE_DECODE, t);
 
-                /* the trailer contains keys and access bits */
-                /* print keyA */
-                pos += sprintf(&str_data_hex[pos], "%s", color_keyA);
-                for(i=0; i<6; i++)
-                {
-                    pos+= sprintf( &str_data_hex[pos], "%02x", keyA[i]);
-                }
-                /* print access bits */
-                pos += sprintf(&str_data_hex[pos], "%s", color_access);
-                for(i=0; i<4; i++)
-                {
-                    pos+= sprintf( &str_data_hex[pos], "%02x", access_bits[i]);
-                }
-                /* print keyB */
-                pos += sprintf(&str_data_hex[pos], "%s", color_keyB);
-                for(i=0; i<6; i++)
-                {
-                    pos+= sprintf( &str_data_hex[pos], "%02x", keyB[i]);
-                }
-                pos += sprintf(&str_data_hex[pos], "%s", color_default);
-            }
-            else
-            {
-                /* print data of one block */
-                for(i=0; i<block_size; i++)
-                {
-                    sprintf( &str_data_hex[i*2], "%02x", data[block_start + i]);
-                }
-            }
+    /* the bytes parsed are counted, padding included, as by a cache hit */
+    res->stats.data_size = data_size;
+    res->stats.sectors = (int)info.sectors;
+    res->stats.access_errors = info.access_errors;
+    if(verbose > 0)
+    {
+        stats_add_dump(&run_stats, data_size, info.access_errors);
+    }
 
-            /* print data of one block in ASCII */
-            pos = 0;
-            for(i=0; i<block_size; i++)
-            {
-                unsigned char *ch = &data[block_start + i];
-                if (isspace(*ch))
-                {
-                    pos+= sprintf( &str_data_ascii[pos], "." );
-                }
-                else if (!isgraph(*ch))
-                {
-                    pos+= sprintf( &str_data_ascii[pos], "." );
-                }
-                else
-                {
-                    pos+= sprintf( &str_data_ascii[pos], "%c", *ch);
-                }
-            }
+    t = stage_start();
+    start = res->out.len;
+    if(build_index != NULL)
+    {
+        r = index_add_dump(&index_builder, name, &info);
+    }
+    else if((audit_path != NULL) || (policy_path != NULL))
+    {
+        unsigned found = 0;
 
-            if((access_condition < 0) || (access_condition > 7))
-            {
-                /* invalid access bits */
-                sprintf( str_access_bits, "%sERR%s", color_warning,
-                    color_default);
+        r = 0;
+        if(audit_path != NULL)
+        {
+            r = audit_dump(&audit_keys, name, &info, fmt.sectors, &res->out,
+                           &found);
+            res->stats.at_risk += found;
+            res->stats.risky_dumps += (found > 0) ? 1u : 0;
+        }
+        if((r == 0) && (policy_path != NULL))
+        {
+            r = policy_check(&policy, name, &info, fmt.sectors, &res->out,
+                             &found);
+            res->stats.violations += found;
+            res->stats.violating_dumps += (found > 0) ? 1u : 0;
+        }
+    }
+    else
+    {
+        switch(fmt.format)
+        {
+        case FORMAT_TEXT:
+            r = fmt.values_only ? render_values(&info, &fmt, &res->out)
+                                : render_text(&info, &fmt, &res->out);
+            break;
+        case FORMAT_BINARY:
+            r = render_binary(&info, &fmt, &res->out);
+            break;
+        default:
+            render_json_head(name, &fmt, &res->out);
+            start = res->out.len;
+            r = fmt.values_only ? render_values(&info, &fmt, &res->out)
+                                : render_json_body(&info, &fmt, &res->out);
+            break;
+        }
+    }
 
-                strcpy( str_permissions, empty_string);
-            }
-            else if((block == 0) && (sector == 0))
-            {
-                /* The 1st block in the 1st sector contains Manufacturer
-                   data that it's not possible to change */
-                sprintf( str_access_bits, "%s%s%s", color_access,
-                    bit_rep[access_condition], color_default);
-                sprintf( str_permissions, "-" );
-            }
-            else if(block == blocks-1)
-            {
-                /* prepare access bits in bin format for trailer */
-                sprintf( str_access_bits, "%s%s%s", color_access,
-                    bit_rep[access_condition], color_default);
-                sprintf( str_permissions, "%s", permission_trailer[access_condition]);
-            }
-            else
-            {
-                /* prepare access bits in bin format */
-                sprintf( str_access_bits, "%s%s%s", color_access,
-                    bit_rep[access_condition], color_default);
-                sprintf( str_permissions, "%s", permission_data[access_condition]);
-            }
+    stage_end(STAGE_FORMAT, t);
 
-            printf("| %-5s|  %-3d | %s |  %s   | %-38s | %s\n", str_sector,
-                   block, str_data_hex, str_access_bits,
-                   str_permissions, str_data_ascii);
+    if((r == 0) && cached)
+    {
+        r = cache_store(&cache, hash, cache_fingerprint(), data, data_size,
+                        &res->out.data[start], res->out.len - start,
+                        info.sectors, info.access_errors);
+    }
 
-        }
+    if(r != 0)
+    {
+        out_printf(&res->err, "Out of memory\n");
+        return EXIT_FAILURE;
     }
-    printf("====================================================================================================\n");
 
     return 0;
 }
 
 /**************************************************************************//**
- *
+ * Appends a copy of the path to the list of files to be processed.
  *****************************************************************************/
-int main(int argc, char **argv)
+static int append_input(struct input_list *list, const char *path)
 {
-    FILE* fp;
-    progname = ident_from_argv0(argv[0]);
+    char *copy;
 
-    while (1)
+    if(list->count == list->capacity)
     {
-        int c, option_index = 0;
-        c = getopt_long(argc, argv, "n1hVv", opts, &option_index);
-        if (c == -1)
-            break;
-
-        switch (c)
+        size_t capacity = list->capacity ? list->capacity * 2u : INPUT_LIST_INITIAL;
+        char **paths = realloc(list->paths, capacity * sizeof(*paths));
+        if(paths == NULL)
         {
-        case 'h':
-        case OPT_LONG_HELP:
-            print_help();
-            exit(EXIT_SUCCESS);
-            break;
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
 
-        case OPT_VERSION:
-            print_version();
-            exit(EXIT_SUCCESS);
-            break;
+    copy = malloc(strlen(path) + 1u);
+    if(copy == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+    strcpy(copy, path);
+    list->paths[list->count++] = copy;
 
-        case 'v':
-        case OPT_VERBOSE:
-            verbose++;
-            break;
+    return 0;
+}
 
-        case '1':
-            force_1k = true;
-            break;
+/**************************************************************************//**
+ * qsort() callback ordering the directory entries by name.
+ *****************************************************************************/
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
 
-        case 'n':
-            colored = false;
-            break;
+/**************************************************************************//**
+ * Fills this_dir in for the directory and checks whether it is being scanned
+ * already, reached again by a loop of symbolic links. Windows has no inode
+ * numbers, the directories are not checked there.
+ *****************************************************************************/
+static bool directory_loop(const char *dir_path, struct scan_dir *this_dir)
+{
+    this_dir->dev = 0;
+    this_dir->ino = 0;
+    this_dir->parent = scan_dirs;
+#ifndef _WIN32
+    {
+        const struct scan_dir *parent;
+        struct stat st;
 
-        default:
-            print_help();
-            exit(EXIT_FAILURE);
-            break;
+        if(stat(dir_path, &st) != 0)
+        {
+            /* the error is reported by opendir() */
+            return false;
+        }
+        this_dir->dev = st.st_dev;
+        this_dir->ino = st.st_ino;
+        for(parent = scan_dirs; parent != NULL; parent = parent->parent)
+        {
+            if((parent->dev == st.st_dev) && (parent->ino == st.st_ino))
+            {
+                return true;
+            }
         }
     }
+#else
+    (void)dir_path;
+#endif
+
+    return false;
+}
+
+/**************************************************************************//**
+ * Adds all files of the directory and its subdirectories to the list.
+ * The entries are sorted by name so the output order does not depend on the
+ * file system. Symbolic links to directories are followed, but a directory
+ * linked from inside of itself is skipped, so a loop of links ends.
+ *****************************************************************************/
+static int scan_directory(struct input_list *list, const char *dir_path)
+{
+    struct input_list entries = { NULL, 0, 0 };
+    struct dirent *entry;
+    struct scan_dir this_dir;
+    DIR *dir;
+    size_t i;
+    int r = 0;
 
-    if( optind == argc )
+    if(directory_loop(dir_path, &this_dir))
     {
-        fprintf(stderr, "No input file has been specified\n");
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "Skipping the directory %s: a loop of links\n",
+                dir_path);
+        return 0;
     }
-    else if( optind != argc - 1)
+    dir = opendir(dir_path);
+    if(dir == NULL)
     {
-        fprintf(stderr, "Only one input file can be specified\n");
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "Error opening the directory %s: %s\n", dir_path,
+                strerror(errno));
+        return -1;
     }
-    else
+
+    while((entry = readdir(dir)) != NULL)
     {
-        input_file = argv[optind];
+        size_t len;
+        char *path;
+
+        if((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+        {
+            continue;
+        }
+
+        len = strlen(dir_path) + strlen(entry->d_name) + 2u;
+        path = malloc(len);
+        if(path == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            r = -1;
+            break;
+        }
+        snprintf(path, len, "%s/%s", dir_path, entry->d_name);
+        r = append_input(&entries, path);
+        free(path);
+        if(r != 0)
+        {
+            break;
+        }
     }
+    closedir(dir);
 
-    if(strcmp(input_file, "-") == 0)
+    if(entries.count > 0)
     {
-        fp = stdin;
+        qsort(entries.paths, entries.count, sizeof(*entries.paths), compare_names);
     }
-    else
+
+    scan_dirs = &this_dir;
+    for(i = 0; i < entries.count; i++)
     {
-        fp = fopen(input_file, "rb");
-        if (fp == NULL)
+        if((r == 0) && (add_input_path(list, entries.paths[i]) != 0))
         {
-           fprintf(stderr, "Error opening the input file %s", input_file);
-           exit(EXIT_FAILURE);
+            r = -1;
         }
+        free(entries.paths[i]);
     }
+    free(entries.paths);
+    scan_dirs = this_dir.parent;
 
-    /* init console to be able to show colors */
-#ifdef _WIN32
-    HANDLE hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
-    DWORD dwMode;
-    GetConsoleMode(hOutput, &dwMode);
-    dwMode |= ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
-    if (!SetConsoleMode(hOutput, dwMode))
+    return r;
+}
+
+/**************************************************************************//**
+ * Adds a file or, recursively, content of a directory to the list.
+ *****************************************************************************/
+static int add_input_path(struct input_list *list, const char *path)
+{
+    struct stat st;
+
+    if(strcmp(path, "-") == 0)
     {
-        colored = false;
+        return append_input(list, path);
     }
-#endif
 
-    if(colored == false)
+    if(stat(path, &st) != 0)
     {
-        /* replace the ANSI codes by an emty string, so the color will not
-           be set */
-        color_keyB = empty_string;
-        color_keyA = empty_string;
-        color_access = empty_string;
-        color_warning = empty_string;
-        color_default = empty_string;
+        fprintf(stderr, "Error opening the input file %s: %s\n", path,
+                strerror(errno));
+        return -1;
     }
 
-    int r = print_info(fp);
+    if(S_ISDIR(st.st_mode))
+    {
+        batch = true;
+        return scan_directory(list, path);
+    }
+    if(archive_name(path))
+    {
+        /* the dumps of an archive are shown like the files of a directory */
+        batch = true;
+    }
 
-    if(fp != stdin)
+    return append_input(list, path);
+}
+
+/**************************************************************************//**
+ * Reads the names of the dump files separated by list_separator. Names that
+ * cannot be added are counted in failed.
+ *****************************************************************************/
+static int read_input_list(struct input_list *list, const char *list_path,
+                           unsigned *failed)
+{
+    FILE *fp;
+    char *name = NULL;
+    size_t len = 0;
+    size_t capacity = 0;
+    int c;
+    int r = 0;
+
+    if(strcmp(list_path, "-") == 0)
     {
-        fclose(fp);
+        fp = stdin;
     }
-    return r;
+    else
+    {
+        fp = fopen(list_path, "r");
+        if(fp == NULL)
+        {
+            fprintf(stderr, "Error opening the file list %s: %s\n", list_path,
+                    strerror(errno));
+            return -1;
+        }
+    }
+
+    do
+    {
+        c = getc(fp);
+        if((c == EOF) || (c == list_separator) ||
+           ((list_separator == '\n') && (c == '\r')))
+        {
+            if(len > 0)
+            {
+                name[len] = '\0';
+                /* not existing files are reported, but do not stop the scan */
+                if(add_input_path(list, name) != 0)
+                {
+                    (*failed)++;
+                }
+                len = 0;
+            }
+            continue;
+        }
+
+        if(len + 1u >= capacity)
+        {
+            size_t new_capacity = capacity ? capacity * 2u : 256u;
+            char *p = realloc(name, new_capacity);
+            if(p == NULL)
+            {
+                fprintf(stderr, "Out of memory\n");
+                r = -1;
+                break;
+            }
+            name = p;
+            capacity = new_capacity;
+        }
+        name[len++] = (char)c;
+    }
+    while(c != EOF);
+
+    free(name);
+    if(fp != stdin)
+    {
+        fclose(fp);
+    }
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Returns the time of the last modification of the file in nanoseconds.
+ *****************************************************************************/
+static int64_t modification_time(const struct stat *st)
+{
+#ifdef _WIN32
+    return (int64_t)st->st_mtime * 1000000000;
+#else
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+/**************************************************************************//**
+ * Drops the input files which have the size and the time of modification
+ * recorded by the manifest. The standard input and the files which are not
+ * regular are always parsed. Returns -1 on out of memory.
+ *****************************************************************************/
+static int skip_unchanged(struct input_list *list)
+{
+    size_t kept = 0;
+    size_t i;
+
+    for(i = 0; i < list->count; i++)
+    {
+        char *path = list->paths[i];
+        struct stat st;
+        int r = 0;
+
+        if((strcmp(path, "-") != 0) && (stat(path, &st) == 0) &&
+           S_ISREG(st.st_mode))
+        {
+            r = manifest_check(&manifest, path, (uint64_t)st.st_size,
+                               modification_time(&st));
+        }
+        if(r < 0)
+        {
+            return -1;
+        }
+        if(r > 0)
+        {
+            free(path);
+        }
+        else
+        {
+            list->paths[kept++] = path;
+        }
+    }
+    list->count = kept;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Reads the rest of the stream to a heap buffer, at most limit bytes.
+ *****************************************************************************/
+static int read_source(FILE *fp, struct dump_source *src, size_t limit)
+{
+    size_t capacity = 0;
+
+    while(src->size < limit)
+    {
+        size_t n;
+
+        if(src->size == capacity)
+        {
+            unsigned char *buffer;
+
+            capacity = capacity ? capacity * 2u : MFD_MAX_DUMP_SIZE + 1u;
+            if(capacity > limit)
+            {
+                capacity = limit;
+            }
+            buffer = realloc(src->buffer, capacity);
+            if(buffer == NULL)
+            {
+                return -1;
+            }
+            src->buffer = buffer;
+        }
+
+        n = fread(&src->buffer[src->size], 1, capacity - src->size, fp);
+        src->size += n;
+        if(n == 0)
+        {
+            break;
+        }
+    }
+    src->data = src->buffer;
+
+    return ferror(fp) ? -1 : 0;
+}
+
+/**************************************************************************//**
+ * Checks whether a regular file of the size can be parsed at all. Dumps have
+ * a few valid sizes only, packs need whole records of --size bytes; with -1
+ * any dump of at least 1k is cut to it.
+ *****************************************************************************/
+static bool acceptable_size(uint64_t size)
+{
+    if(pack_size > 0)
+    {
+        return true;
+    }
+    if(force_1k)
+    {
+        return size >= 1024u;
+    }
+
+    return (size <= MFD_MAX_DUMP_SIZE) && (mfd_card_sectors((size_t)size) > 0);
+}
+
+/**************************************************************************//**
+ * Releases the mapping or the buffer of the input file.
+ *****************************************************************************/
+static void close_source(struct dump_source *src)
+{
+#ifndef _WIN32
+    if(src->map != NULL)
+    {
+        munmap(src->map, src->size);
+    }
+#endif
+    free(src->buffer);
+}
+
+/**************************************************************************//**
+ * Converts the content of the input to a binary dump if it is a dump saved
+ * as text by other tools. Inputs of the sizes of the binary dumps are never
+ * taken for text.
+ *****************************************************************************/
+static int import_source(const char *path, struct dump_source *src,
+                         struct dump_result *res)
+{
+    unsigned char *dump;
+    size_t size;
+    unsigned long line;
+    int kind;
+
+    if((pack_size > 0) || (src->data == NULL) || acceptable_size(src->size))
+    {
+        return 0;
+    }
+    kind = import_detect(src->data, src->size);
+    if(kind == IMPORT_NONE)
+    {
+        return 0;
+    }
+
+    dump = malloc(MFD_MAX_DUMP_SIZE);
+    if(dump == NULL)
+    {
+        out_printf(&res->err, "Out of memory\n");
+        return -1;
+    }
+    if(import_parse(kind, src->data, src->size, dump, &size, &line) != 0)
+    {
+        out_printf(&res->err, "Error in the %s dump %s on line %lu\n",
+                   import_name(kind), path, line);
+        free(dump);
+        return -1;
+    }
+
+    close_source(src);
+    memset(src, 0, sizeof(*src));
+    src->buffer = dump;
+    src->data = dump;
+    src->size = size;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Makes content of the input file accessible in memory. Big regular files,
+ * like packs of dumps, are mapped and parsed in place. Other inputs are read
+ * to a buffer, for a single dump that is cheaper than setting up a mapping.
+ *****************************************************************************/
+static int open_input(const char *path, struct dump_source *src,
+                      struct dump_result *res)
+{
+    /* a single dump is never longer, one more byte detects bigger files */
+    size_t limit = (pack_size > 0) ? SIZE_MAX : MFD_MAX_DUMP_SIZE + 1u;
+    FILE *fp;
+    int r;
+
+    memset(src, 0, sizeof(*src));
+
+    if(strcmp(path, "-") == 0)
+    {
+        /* the stream may be a text dump */
+        r = read_source(stdin, src, (pack_size > 0) ? limit : IMPORT_MAX_SIZE);
+    }
+    else
+    {
+#ifndef _WIN32
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        bool regular;
+
+        if(fd < 0)
+        {
+            out_printf(&res->err, "Error opening the input file %s: %s\n",
+                       path, strerror(errno));
+            return -1;
+        }
+        regular = (fstat(fd, &st) == 0) && S_ISREG(st.st_mode);
+        if(regular && !acceptable_size((uint64_t)st.st_size))
+        {
+            /* the size is reported by print_info(), the file is not read
+               unless it starts like an archive or a text dump */
+            unsigned char head[ARCHIVE_PROBE_SIZE];
+            ssize_t n = pread(fd, head, sizeof(head), 0);
+            size_t len = (n > 0) ? (size_t)n : 0;
+
+            src->archive = archive_detect(head, len);
+            if((src->archive != ARCHIVE_NONE) ||
+               (st.st_size > (off_t)IMPORT_MAX_SIZE) ||
+               (import_detect(head, len) == IMPORT_NONE))
+            {
+                close(fd);
+                src->size = (size_t)st.st_size;
+                return 0;
+            }
+            limit = IMPORT_MAX_SIZE;
+        }
+        if(regular && (st.st_size >= MMAP_MIN_SIZE))
+        {
+            void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                             fd, 0);
+            if(map != MAP_FAILED)
+            {
+                close(fd);
+                src->map = map;
+                src->data = map;
+                src->size = (size_t)st.st_size;
+                return 0;
+            }
+        }
+        /* fall back to reading of the file */
+        fp = fdopen(fd, "rb");
+        if(fp == NULL)
+        {
+            close(fd);
+        }
+#else
+        fp = fopen(path, "rb");
+#endif
+        if(fp == NULL)
+        {
+            out_printf(&res->err, "Error opening the input file %s: %s\n",
+                       path, strerror(errno));
+            return -1;
+        }
+        r = read_source(fp, src, limit);
+        fclose(fp);
+    }
+
+    if(r != 0)
+    {
+        out_printf(&res->err, "Error reading the input file %s\n", path);
+        free(src->buffer);
+    }
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Opens the input file and converts a text dump to the binary layout.
+ *****************************************************************************/
+static int open_source(const char *path, struct dump_source *src,
+                       struct dump_result *res)
+{
+    if(open_input(path, src, res) != 0)
+    {
+        return -1;
+    }
+    if(import_source(path, src, res) != 0)
+    {
+        close_source(src);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Checks the dump against the --match expressions before anything else is
+ * done with it. Dumps of wrong sizes are passed on to report the error.
+ *****************************************************************************/
+static bool dump_wanted(const unsigned char *data, size_t size,
+                        struct dump_result *res)
+{
+    size_t data_size = force_1k ? 1024u : size;
+
+    if((matches.count == 0) || (data == NULL) || (size < data_size) ||
+       (mfd_card_sectors(data_size) == 0))
+    {
+        return true;
+    }
+    if(!match_dump(&matches, data, data_size))
+    {
+        return false;
+    }
+    res->stats.matched++;
+
+    return true;
+}
+
+/**************************************************************************//**
+ * Parses one dump. In batch mode the text of the dump is framed by a header
+ * and a summary line showing the name.
+ *****************************************************************************/
+static int process_dump(const char *name, const unsigned char *data,
+                        size_t size, struct dump_result *res)
+{
+    int r;
+    /* nothing but errors is written while the index is built, the audit
+       and the policy list just the findings */
+    bool framed = batch && (fmt.format == FORMAT_TEXT) &&
+                  (build_index == NULL) && (audit_path == NULL) &&
+                  (policy_path == NULL);
+
+    if(!dump_wanted(data, size, res))
+    {
+        return 0;
+    }
+
+    if(framed)
+    {
+        out_printf(&res->out, "==> %s <==\n", name);
+    }
+
+    r = print_info(name, data, size, res);
+
+    if(framed)
+    {
+        if(r == 0)
+        {
+            out_printf(&res->out,
+                       "--> %s: %u bytes, %d sectors, %u invalid trailers\n\n",
+                       name, res->stats.data_size, res->stats.sectors,
+                       res->stats.access_errors);
+        }
+        else
+        {
+            out_printf(&res->out, "--> %s: FAILED\n\n", name);
+        }
+    }
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Checks the contents of the input file read for parsing against the
+ * manifest. Returns true if only the time of modification has changed since
+ * the last run, so the file need not be parsed again. The hash of the
+ * contents, 0 if they have not been read whole, is stored to hash.
+ *****************************************************************************/
+static bool same_contents(const char *path, const unsigned char *data,
+                          size_t size, uint64_t *hash)
+{
+    *hash = 0;
+    if(manifest_path == NULL)
+    {
+        return false;
+    }
+    if(data != NULL)
+    {
+        *hash = mfd_xxh64(data, size);
+    }
+
+    return manifest_same_hash(&manifest, path, *hash);
+}
+
+/**************************************************************************//**
+ * Parses one member of an archive.
+ *****************************************************************************/
+static int archive_dump(void *ctx, const char *name, const unsigned char *data,
+                        size_t size)
+{
+    struct archive_scan *scan = ctx;
+    int r = process_dump(name, data, size, scan->res);
+
+    if(scan->flush)
+    {
+        write_result(scan->res);
+    }
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Opens and parses one dump file, or all the dumps of a pack when the size of
+ * the dumps is given. The whole output is collected in res, so the files
+ * can be parsed in parallel and still printed in order.
+ *****************************************************************************/
+static int process_file(const char *path, struct dump_result *res)
+{
+    struct dump_source src;
+    uint64_t hash;
+    int r = 0;
+    uint64_t t = stage_start();
+
+    if(open_source(path, &src, res) != 0)
+    {
+        return -1;
+    }
+    stage_end(STAGE_READ, t);
+
+    if(same_contents(path, src.data, src.size, &hash))
+    {
+        close_source(&src);
+        return 0;
+    }
+
+    if(src.archive != ARCHIVE_NONE)
+    {
+        struct archive_scan scan = { res, sequential };
+        unsigned failed = 0;
+
+        /* one more byte than a dump detects bigger members */
+        r = archive_read(path, src.archive, MFD_MAX_DUMP_SIZE + 1u,
+                         acceptable_size, archive_dump, &scan, &res->err,
+                         &failed);
+        if(failed > 0)
+        {
+            r = -1;
+        }
+    }
+    else if(pack_size == 0)
+    {
+        r = process_dump(path, src.data, src.size, res);
+    }
+    else if(archive_detect(src.data, (src.size < ARCHIVE_PROBE_SIZE)
+                                     ? src.size : ARCHIVE_PROBE_SIZE) !=
+            ARCHIVE_NONE)
+    {
+        /* the headers of an archive would be taken for records */
+        out_printf(&res->err, "%s: packs of --size dumps are not read from "
+                   "archives\n", path);
+        r = -1;
+    }
+    else
+    {
+        size_t offset;
+        unsigned long record = 0;
+
+        for(offset = 0; offset < src.size; offset += pack_size)
+        {
+            size_t size = src.size - offset;
+            char name[PATH_NAME_MAX];
+
+            if(size > pack_size)
+            {
+                size = pack_size;
+            }
+            snprintf(name, sizeof(name), "%s [%lu]", path, record++);
+            if(process_dump(name, &src.data[offset], size, res) != 0)
+            {
+                r = -1;
+            }
+        }
+    }
+
+    close_source(&src);
+    if((r == 0) && (manifest_path != NULL))
+    {
+        manifest_done(&manifest, path, hash);
+    }
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Resolves the path of a dump file requested by a client of --serve. Returns
+ * the resolved path to be freed, or NULL unless it names a file below the
+ * --serve-root directory, so the clients cannot read other files of the user
+ * running the server.
+ *****************************************************************************/
+static char *served_path(const char *path)
+{
+    char *real;
+    size_t len;
+
+    if(serve_root == NULL)
+    {
+        return NULL;
+    }
+    real = realpath(path, NULL);
+    if(real == NULL)
+    {
+        return NULL;
+    }
+    len = strlen(serve_root);
+    if((strncmp(real, serve_root, len) != 0) ||
+       ((real[len] != '/') &&
+        ((serve_root[len - 1u] != '/') || (real[len] == '\0'))))
+    {
+        free(real);
+        return NULL;
+    }
+
+    return real;
+}
+
+/**************************************************************************//**
+ * Answers one request of the --serve mode: a dump sent over the socket or a
+ * dump file named by its path. The output buffers of the worker are lent to
+ * the result, so they are reused by all its requests.
+ *****************************************************************************/
+static int serve_request(const char *path, const unsigned char *data,
+                         size_t size, struct output *out, struct output *err)
+{
+    struct dump_result res;
+    int r;
+
+    memset(&res, 0, sizeof(res));
+    res.out = *out;
+    res.err = *err;
+    if(path != NULL)
+    {
+        char *real = served_path(path);
+
+        if(real == NULL)
+        {
+            out_printf(&res.err, (serve_root == NULL)
+                       ? "Files are not served without --serve-root: %s\n"
+                       : "Not a file below the served directory: %s\n", path);
+            r = EXIT_FAILURE;
+        }
+        else
+        {
+            r = process_file(real, &res);
+            free(real);
+        }
+    }
+    else
+    {
+        struct dump_source src;
+
+        memset(&src, 0, sizeof(src));
+        src.data = data;
+        src.size = size;
+        r = import_source("-", &src, &res);
+        if((r == 0) && dump_wanted(src.data, src.size, &res))
+        {
+            r = print_info("-", src.data, src.size, &res);
+        }
+        close_source(&src);
+    }
+    *out = res.out;
+    *err = res.err;
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Parses a continuous stream of dumps of pack_size bytes. Every dump is
+ * printed as soon as it has been read, so only one dump is kept in memory
+ * and the end of the stream is not needed.
+ *****************************************************************************/
+static int process_stream(const char *path)
+{
+    struct dump_result res;
+    unsigned char data[MFD_MAX_DUMP_SIZE];
+    unsigned long record = 0;
+    FILE *fp;
+    int r = 0;
+
+    if(strcmp(path, "-") == 0)
+    {
+        fp = stdin;
+    }
+    else
+    {
+        fp = fopen(path, "rb");
+        if(fp == NULL)
+        {
+            fprintf(stderr, "Error opening the input file %s: %s\n", path,
+                    strerror(errno));
+            return -1;
+        }
+    }
+
+    memset(&res, 0, sizeof(res));
+    while(1)
+    {
+        char name[PATH_NAME_MAX];
+        uint64_t t = stage_start();
+        size_t size = fread(data, 1, pack_size, fp);
+
+        stage_end(STAGE_READ, t);
+
+        if(size == 0)
+        {
+            break;
+        }
+
+        if(size < pack_size)
+        {
+            fprintf(stderr, "Truncated dump at the end of %s: %lu bytes\n",
+                    path, (unsigned long)size);
+            r = -1;
+            break;
+        }
+
+        snprintf(name, sizeof(name), "%s [%lu]", path, record++);
+        if(process_dump(name, data, size, &res) != 0)
+        {
+            r = -1;
+        }
+        write_result(&res);
+        fflush(stdout);
+    }
+
+    if(ferror(fp))
+    {
+        fprintf(stderr, "Error reading the input file %s\n", path);
+        r = -1;
+    }
+    free_result(&res);
+    if(fp != stdin)
+    {
+        fclose(fp);
+    }
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Prints the collected output of one dump. The buffers are kept for the next
+ * dump.
+ *****************************************************************************/
+static void write_result(struct dump_result *res)
+{
+    uint64_t t = stage_start();
+
+    if(res->err.len > 0)
+    {
+        fflush(stdout);
+        fwrite(res->err.data, 1, res->err.len, stderr);
+    }
+    if(res->out.len > 0)
+    {
+        const char *data = res->out.data;
+        size_t len = res->out.len;
+
+        if(fmt.json_array && (json_items++ == 0))
+        {
+            fputs("[\n", stdout);
+            data++;
+            len--;
+        }
+        fwrite(data, 1, len, stdout);
+    }
+    res->out.len = 0;
+    res->err.len = 0;
+    audit_sectors += res->stats.at_risk;
+    audit_dumps += res->stats.risky_dumps;
+    policy_violations += res->stats.violations;
+    policy_dumps += res->stats.violating_dumps;
+    res->stats.at_risk = 0;
+    res->stats.risky_dumps = 0;
+    res->stats.violations = 0;
+    res->stats.violating_dumps = 0;
+    matched_dumps += res->stats.matched;
+    res->stats.matched = 0;
+    stage_end(STAGE_WRITE, t);
+}
+
+/**************************************************************************//**
+ * Releases the buffers of the dump output.
+ *****************************************************************************/
+static void free_result(struct dump_result *res)
+{
+    free(res->out.data);
+    free(res->err.data);
+    memset(res, 0, sizeof(*res));
+}
+
+/**************************************************************************//**
+ * Worker thread of the parallel batch mode. Takes the next file from the
+ * queue, parses it into a free slot and notifies the writer.
+ *****************************************************************************/
+static void *batch_worker(void *arg)
+{
+    struct batch_queue *q = arg;
+
+    while(1)
+    {
+        struct batch_slot *slot;
+        size_t job;
+
+        pthread_mutex_lock(&q->lock);
+        while((q->next_job < q->inputs->count) &&
+              (q->next_job >= q->written + q->window))
+        {
+            pthread_cond_wait(&q->slot_free, &q->lock);
+        }
+        if(q->next_job >= q->inputs->count)
+        {
+            pthread_mutex_unlock(&q->lock);
+            break;
+        }
+        job = q->next_job++;
+        pthread_mutex_unlock(&q->lock);
+
+        slot = &q->slots[job % q->window];
+        slot->status = process_file(q->inputs->paths[job], &slot->res);
+
+        pthread_mutex_lock(&q->lock);
+        slot->ready = true;
+        pthread_cond_broadcast(&q->slot_ready);
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * Tells how much of the file io_uring is to read, as much as open_input()
+ * reads: a dump of a valid size whole, of the other files the head telling
+ * the archives and the text dumps, and the text dumps whole.
+ *****************************************************************************/
+static size_t uring_size(void *ctx, uint64_t size, const unsigned char *data,
+                         size_t len)
+{
+    (void)ctx;
+
+    if(acceptable_size(size))
+    {
+        /* the dumps cut by -1 are left to the blocking way */
+        return (size <= MFD_MAX_DUMP_SIZE) ? (size_t)size : 0;
+    }
+    if(data == NULL)
+    {
+        return (size < ARCHIVE_PROBE_SIZE) ? (size_t)size : ARCHIVE_PROBE_SIZE;
+    }
+    if((size <= IMPORT_MAX_SIZE) &&
+       (archive_detect(data, len) == ARCHIVE_NONE) &&
+       (import_detect(data, len) != IMPORT_NONE))
+    {
+        return (size_t)size;
+    }
+
+    return len;
+}
+
+/**************************************************************************//**
+ * Parses one file read by io_uring and writes its output.
+ *****************************************************************************/
+static int uring_dump(void *ctx, size_t index, const unsigned char *data,
+                      size_t len, uint64_t size, int error)
+{
+    struct uring_scan *scan = ctx;
+    const char *path = scan->inputs->paths[index];
+    int r;
+
+    if((error != 0) ||
+       ((len < size) && (acceptable_size(size) ||
+                         (archive_detect(data, len) != ARCHIVE_NONE))))
+    {
+        /* the blocking way reports the errors, reads the archives and the
+           dumps cut by -1 */
+        r = process_file(path, &scan->res);
+    }
+    else
+    {
+        struct dump_source src;
+        uint64_t hash;
+
+        /* just the head of a file of a wrong size has been read unless it
+           is a text dump, the size of the rest is reported */
+        memset(&src, 0, sizeof(src));
+        src.data = (len < size) ? NULL : data;
+        src.size = (size_t)size;
+        r = import_source(path, &src, &scan->res);
+        if((r == 0) && !same_contents(path, src.data, src.size, &hash))
+        {
+            r = process_dump(path, src.data, src.size, &scan->res);
+            if((r == 0) && (manifest_path != NULL))
+            {
+                manifest_done(&manifest, path, hash);
+            }
+        }
+        close_source(&src);
+    }
+    if(r != 0)
+    {
+        scan->failed++;
+    }
+    write_result(&scan->res);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Parses all the input files one by one in this thread. Single dumps are read
+ * by io_uring, which keeps many opens and reads in flight, where available;
+ * the rest of the files is read the blocking way. Returns the number of
+ * failed files.
+ *****************************************************************************/
+static unsigned process_sequential(struct input_list *inputs)
+{
+    struct uring_scan scan;
+    size_t i = 0;
+
+    memset(&scan, 0, sizeof(scan));
+    scan.inputs = inputs;
+    sequential = true;
+
+    if((pack_size == 0) && (inputs->count > 1))
+    {
+        /* the longer text dumps get buffers of their own */
+        uring_read_files((const char *const *)inputs->paths, inputs->count,
+                         URING_DEPTH, MFD_MAX_DUMP_SIZE, uring_size,
+                         uring_dump, &scan, &i);
+    }
+
+    for(; i < inputs->count; i++)
+    {
+        if(process_file(inputs->paths[i], &scan.res) != 0)
+        {
+            scan.failed++;
+        }
+        write_result(&scan.res);
+    }
+    free_result(&scan.res);
+
+    return scan.failed;
+}
+
+/**************************************************************************//**
+ * Parses all the input files by a pool of worker threads. The output of the
+ * dumps is written by the calling thread in the order of the inputs.
+ * Returns the number of failed files.
+ *****************************************************************************/
+static unsigned process_parallel(struct input_list *inputs, unsigned threads)
+{
+    struct batch_queue q;
+    pthread_t *workers;
+    unsigned started = 0;
+    unsigned failed = 0;
+    size_t i;
+
+    memset(&q, 0, sizeof(q));
+    q.inputs = inputs;
+    q.window = threads * BATCH_SLOTS_PER_THREAD;
+    q.slots = calloc(q.window, sizeof(*q.slots));
+    workers = calloc(threads, sizeof(*workers));
+    if((q.slots == NULL) || (workers == NULL))
+    {
+        fprintf(stderr, "Out of memory\n");
+        free(q.slots);
+        free(workers);
+        return (unsigned)inputs->count;
+    }
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.slot_ready, NULL);
+    pthread_cond_init(&q.slot_free, NULL);
+
+    for(started = 0; started < threads; started++)
+    {
+        if(pthread_create(&workers[started], NULL, batch_worker, &q) != 0)
+        {
+            break;
+        }
+    }
+    if(started == 0)
+    {
+        /* no thread could be created, parse the files in this one */
+        batch_worker(&q);
+    }
+
+    for(i = 0; i < inputs->count; i++)
+    {
+        struct batch_slot *slot = &q.slots[i % q.window];
+
+        pthread_mutex_lock(&q.lock);
+        while(!slot->ready)
+        {
+            pthread_cond_wait(&q.slot_ready, &q.lock);
+        }
+        pthread_mutex_unlock(&q.lock);
+
+        if(slot->status != 0)
+        {
+            failed++;
+        }
+        write_result(&slot->res);
+
+        pthread_mutex_lock(&q.lock);
+        slot->ready = false;
+        q.written++;
+        pthread_cond_broadcast(&q.slot_free);
+        pthread_mutex_unlock(&q.lock);
+    }
+
+    for(i = 0; i < started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    for(i = 0; i < q.window; i++)
+    {
+        free_result(&q.slots[i].res);
+    }
+
+    pthread_cond_destroy(&q.slot_free);
+    pthread_cond_destroy(&q.slot_ready);
+    pthread_mutex_destroy(&q.lock);
+    free(workers);
+    free(q.slots);
+
+    return failed;
+}
+
+/**************************************************************************//**
+ * Prepares the console to show colors, or turns them off.
+ *****************************************************************************/
+static void init_colors(void)
+{
+#ifdef _WIN32
+    HANDLE hOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD dwMode;
+    GetConsoleMode(hOutput, &dwMode);
+    dwMode |= ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING;
+    if (!SetConsoleMode(hOutput, dwMode))
+    {
+        colored = false;
+    }
+#endif
+
+    if(colored == false)
+    {
+        fmt.colors = &palette_plain;
+    }
+}
+
+/**************************************************************************//**
+ * Compares two dump files, the differences are collected in res.
+ * Returns DIFF_SAME, DIFF_CHANGED or DIFF_TROUBLE.
+ *****************************************************************************/
+static int diff_files(const char *path_a, const char *path_b,
+                      struct dump_result *res)
+{
+    struct dump_source a, b;
+    struct mfd_dump da, db;
+    unsigned changed;
+    int r = DIFF_TROUBLE;
+
+    if(open_source(path_a, &a, res) != 0)
+    {
+        return DIFF_TROUBLE;
+    }
+    if(open_source(path_b, &b, res) != 0)
+    {
+        close_source(&a);
+        return DIFF_TROUBLE;
+    }
+
+    if(mfd_decode(a.data, a.size, &da) != MFD_OK)
+    {
+        out_printf(&res->err, "Wrong file size of %s: %lu bytes.\n", path_a,
+                   (unsigned long)a.size);
+    }
+    else if(mfd_decode(b.data, b.size, &db) != MFD_OK)
+    {
+        out_printf(&res->err, "Wrong file size of %s: %lu bytes.\n", path_b,
+                   (unsigned long)b.size);
+    }
+    else if((da.data_size != db.data_size) || (da.sectors != db.sectors))
+    {
+        /* the decoded card is compared, a dump padded with more bytes is
+           still the dump of its card */
+        out_printf(&res->err, "%s and %s are dumps of different cards\n",
+                   path_a, path_b);
+    }
+    else if(render_diff(path_a, &da, path_b, &db, &fmt, &res->out,
+                        &changed) != 0)
+    {
+        out_printf(&res->err, "Out of memory\n");
+    }
+    else
+    {
+        r = (changed > 0) ? DIFF_CHANGED : DIFF_SAME;
+    }
+
+    close_source(&b);
+    close_source(&a);
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Compares two dump files, or the dumps of the same relative names in two
+ * directories, e.g. two days of reads of the same cards. Dumps found in one
+ * directory only are listed. Returns the exit status.
+ *****************************************************************************/
+static int diff_inputs(const char *path_a, const char *path_b)
+{
+    struct input_list la = { NULL, 0, 0 };
+    struct input_list lb = { NULL, 0, 0 };
+    struct dump_result res;
+    struct stat st;
+    size_t ia = 0, ib = 0;
+    size_t prefix_a = strlen(path_a) + 1u;
+    size_t prefix_b = strlen(path_b) + 1u;
+    unsigned compared = 0, changed = 0, failed = 0;
+    int status = DIFF_SAME;
+
+    memset(&res, 0, sizeof(res));
+
+    if((stat(path_a, &st) != 0) || !S_ISDIR(st.st_mode))
+    {
+        status = diff_files(path_a, path_b, &res);
+        write_result(&res);
+        free_result(&res);
+        return status;
+    }
+
+    if((scan_directory(&la, path_a) != 0) || (scan_directory(&lb, path_b) != 0))
+    {
+        status = DIFF_TROUBLE;
+    }
+    /* the prefix is the same for all the paths of a list, so the relative
+       names are in the same order as the paths */
+    if(la.count > 0)
+    {
+        qsort(la.paths, la.count, sizeof(*la.paths), compare_names);
+    }
+    if(lb.count > 0)
+    {
+        qsort(lb.paths, lb.count, sizeof(*lb.paths), compare_names);
+    }
+
+    while((status != DIFF_TROUBLE) && ((ia < la.count) || (ib < lb.count)))
+    {
+        int order;
+
+        if(ia == la.count)
+        {
+            order = 1;
+        }
+        else if(ib == lb.count)
+        {
+            order = -1;
+        }
+        else
+        {
+            order = strcmp(&la.paths[ia][prefix_a], &lb.paths[ib][prefix_b]);
+        }
+
+        if(order < 0)
+        {
+            out_printf(&res.out, "Only in %s: %s\n", path_a,
+                       &la.paths[ia++][prefix_a]);
+            changed++;
+        }
+        else if(order > 0)
+        {
+            out_printf(&res.out, "Only in %s: %s\n", path_b,
+                       &lb.paths[ib++][prefix_b]);
+            changed++;
+        }
+        else
+        {
+            int r = diff_files(la.paths[ia++], lb.paths[ib++], &res);
+
+            compared++;
+            if(r == DIFF_CHANGED)
+            {
+                changed++;
+            }
+            else if(r == DIFF_TROUBLE)
+            {
+                failed++;
+            }
+        }
+        write_result(&res);
+    }
+    free_result(&res);
+
+    for(ia = 0; ia < la.count; ia++)
+    {
+        free(la.paths[ia]);
+    }
+    for(ib = 0; ib < lb.count; ib++)
+    {
+        free(lb.paths[ib]);
+    }
+    free(la.paths);
+    free(lb.paths);
+
+    fprintf(stderr, "%u dumps compared, %u differ, %u failed\n", compared,
+            changed, failed);
+
+    if((status == DIFF_TROUBLE) || (failed > 0))
+    {
+        return DIFF_TROUBLE;
+    }
+
+    return (changed > 0) ? DIFF_CHANGED : DIFF_SAME;
+}
+
+/**************************************************************************//**
+ * Parses the key given by 12 hex digits. Returns -1 if it is not a key.
+ *****************************************************************************/
+static int parse_key(const char *text, uint64_t *key)
+{
+    unsigned i;
+
+    *key = 0;
+    for(i = 0; i < 12u; i++)
+    {
+        char c = text[i];
+        unsigned digit;
+
+        if((c >= '0') && (c <= '9'))
+        {
+            digit = (unsigned)(c - '0');
+        }
+        else if((c >= 'a') && (c <= 'f'))
+        {
+            digit = (unsigned)(c - 'a' + 10);
+        }
+        else if((c >= 'A') && (c <= 'F'))
+        {
+            digit = (unsigned)(c - 'A' + 10);
+        }
+        else
+        {
+            return -1;
+        }
+        *key = (*key << 4) | digit;
+    }
+
+    return (text[12] == '\0') ? 0 : -1;
+}
+
+/**************************************************************************//**
+ * Tells whether the dump of the index written by the last run comes from an
+ * input file kept by the manifest. The names of the dumps of packs have the
+ * number of the dump appended in brackets and the names of the members of
+ * archives follow the path of the archive after a colon.
+ *****************************************************************************/
+static bool kept_dump(void *ctx, const char *name)
+{
+    char path[PATH_NAME_MAX];
+    size_t len = strlen(name);
+    size_t i;
+
+    (void)ctx;
+    if(manifest_kept(&manifest, name))
+    {
+        return true;
+    }
+    if(len >= sizeof(path))
+    {
+        return false;
+    }
+
+    for(i = len; i > 1; i--)
+    {
+        if((name[i - 1u] == ':') ||
+           ((name[i - 1u] == ' ') && (name[i] == '[')))
+        {
+            memcpy(path, name, i - 1u);
+            path[i - 1u] = '\0';
+            if(manifest_kept(&manifest, path))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/**************************************************************************//**
+ * Adds the dumps of the files kept by the manifest from the index written by
+ * the last run, so the new index covers the whole corpus again. Without the
+ * last index no file was kept. Returns -1 and sets errno on failure.
+ *****************************************************************************/
+static int update_index(void)
+{
+    int r;
+
+    if(!last_index_open)
+    {
+        return 0;
+    }
+    r = index_add_index(&index_builder, &last_index, kept_dump, NULL);
+    index_close(&last_index);
+    last_index_open = false;
+    if(r != 0)
+    {
+        errno = ENOMEM;
+    }
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Answers the --key and --top queries from the index file without parsing
+ * any dump.
+ *****************************************************************************/
+static int query_index(void)
+{
+    struct index_map idx;
+    uint64_t key = 0;
+
+    if((query_key != NULL) && (parse_key(query_key, &key) != 0))
+    {
+        fprintf(stderr, "Key must be 12 hex digits: %s\n", query_key);
+        return EXIT_FAILURE;
+    }
+    if(index_open(index_path, &idx) != 0)
+    {
+        fprintf(stderr, "Error opening the index %s: %s\n", index_path,
+                (errno == EINVAL) ? "not a valid index" : strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if(query_key != NULL)
+    {
+        const struct index_slot *slot = index_find(&idx, key);
+
+        if(slot != NULL)
+        {
+            uint32_t i;
+            uint32_t count = slot->count_a + slot->count_b;
+
+            for(i = 0; i < count; i++)
+            {
+                const struct index_posting *p = &idx.postings[slot->first + i];
+
+                printf("%s: sector %u, key %c\n", index_dump_name(&idx, p->dump),
+                       (unsigned)p->sector, (p->which == MFD_KEY_A) ? 'A' : 'B');
+            }
+        }
+    }
+
+    if(top_keys > 0)
+    {
+        const struct index_slot **top = malloc(top_keys * sizeof(*top));
+        size_t found, i;
+
+        if(top == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            index_close(&idx);
+            return EXIT_FAILURE;
+        }
+        found = index_top(&idx, top, top_keys);
+        for(i = 0; i < found; i++)
+        {
+            printf("%06lX%06lX %lu sectors, key A %lu, key B %lu\n",
+                   (unsigned long)(top[i]->key >> 24),
+                   (unsigned long)(top[i]->key & 0xffffffu),
+                   (unsigned long)top[i]->count_a + top[i]->count_b,
+                   (unsigned long)top[i]->count_a,
+                   (unsigned long)top[i]->count_b);
+        }
+        free(top);
+    }
+
+    index_close(&idx);
+
+    return EXIT_SUCCESS;
+}
+
+/**************************************************************************//**
+ *
+ *****************************************************************************/
+int main(int argc, char **argv)
+{
+    struct input_list inputs = { NULL, 0, 0 };
+    unsigned failed = 0;
+    bool index_failed = false;
+    uint64_t mask;
+    size_t i;
+    progname = ident_from_argv0(argv[0]);
+
+    while (1)
+    {
+        int c, option_index = 0;
+        c = getopt_long(argc, argv, "n1hVvf:0j:s:c", opts, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+        case 'h':
+        case OPT_LONG_HELP:
+            print_help();
+            exit(EXIT_SUCCESS);
+            break;
+
+        case OPT_VERSION:
+            print_version();
+            exit(EXIT_SUCCESS);
+            break;
+
+        case 'v':
+        case OPT_VERBOSE:
+            verbose++;
+            break;
+
+        case '1':
+            force_1k = true;
+            break;
+
+        case 'n':
+            colored = false;
+            break;
+
+        case 'c':
+            fmt.compact = true;
+            break;
+
+        case 'f':
+            files_from = optarg;
+            break;
+
+        case '0':
+            list_separator = '\0';
+            break;
+
+        case 'j':
+            jobs = (unsigned)strtoul(optarg, NULL, 0);
+            if((jobs == 0) || (jobs > MAX_JOBS))
+            {
+                fprintf(stderr, "Number of jobs must be 1 to %u\n", MAX_JOBS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case OPT_FORMAT:
+            if(strcmp(optarg, "text") == 0)
+            {
+                fmt.format = FORMAT_TEXT;
+            }
+            else if(strcmp(optarg, "json") == 0)
+            {
+                fmt.format = FORMAT_JSON;
+            }
+            else if(strcmp(optarg, "ndjson") == 0)
+            {
+                fmt.format = FORMAT_NDJSON;
+            }
+            else if(strcmp(optarg, "binary") == 0)
+            {
+                fmt.format = FORMAT_BINARY;
+            }
+            else
+            {
+                fprintf(stderr, "Unknown output format %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case OPT_STREAM:
+            stream = true;
+            batch = true;
+            break;
+
+        case 's':
+            pack_size = (size_t)strtoul(optarg, NULL, 0);
+            if((pack_size == 0) || (pack_size > MFD_MAX_DUMP_SIZE))
+            {
+                fprintf(stderr, "Size of dumps must be 1 to %u bytes\n",
+                        MFD_MAX_DUMP_SIZE);
+                exit(EXIT_FAILURE);
+            }
+            batch = true;
+            break;
+
+        case OPT_BUILD_INDEX:
+            build_index = optarg;
+            break;
+
+        case OPT_INDEX:
+            index_path = optarg;
+            break;
+
+        case OPT_KEY:
+            query_key = optarg;
+            break;
+
+        case OPT_VALUES_ONLY:
+            fmt.values_only = true;
+            break;
+
+        case OPT_DIFF:
+            diff = true;
+            break;
+
+        case OPT_SECTORS:
+            if(parse_ranges(optarg, MAX_SECTORS, &fmt.sectors) != 0)
+            {
+                fprintf(stderr, "Sectors must be a list like 1-3,10 of "
+                        "numbers 0 to %u\n", MAX_SECTORS - 1u);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case OPT_BLOCKS:
+            if(parse_ranges(optarg, MAX_BLOCKS, &mask) != 0)
+            {
+                fprintf(stderr, "Blocks must be a list like 0-2 of "
+                        "numbers 0 to %u\n", MAX_BLOCKS - 1u);
+                exit(EXIT_FAILURE);
+            }
+            fmt.blocks = (uint16_t)mask;
+            break;
+
+        case OPT_CACHE:
+            cache_path = optarg;
+            break;
+
+        case OPT_AUDIT:
+            audit_path = optarg;
+            break;
+
+        case OPT_POLICY:
+            policy_path = optarg;
+            break;
+
+        case OPT_SERVE:
+            serve_path = optarg;
+            break;
+
+        case OPT_MATCH:
+            if(match_add(&matches, optarg) != 0)
+            {
+                fprintf(stderr, "Not a valid match expression: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case OPT_MANIFEST:
+            manifest_path = optarg;
+            break;
+
+        case OPT_SERVE_ROOT:
+            free(serve_root);
+            serve_root = realpath(optarg, NULL);
+            if(serve_root == NULL)
+            {
+                fprintf(stderr, "Error opening the directory %s: %s\n",
+                        optarg, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case OPT_TOP:
+            top_keys = strtoul(optarg, NULL, 0);
+            if((top_keys == 0) || (top_keys > MAX_TOP_KEYS))
+            {
+                fprintf(stderr, "Number of keys must be 1 to %u\n",
+                        MAX_TOP_KEYS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        default:
+            print_help();
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    stats_init(&run_stats);
+
+    if(fmt.values_only && (fmt.format == FORMAT_BINARY))
+    {
+        fprintf(stderr, "The binary format has no records of values\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(((audit_path != NULL) || (policy_path != NULL)) &&
+       ((fmt.format != FORMAT_TEXT) || fmt.values_only || (build_index != NULL)))
+    {
+        fprintf(stderr, "--audit and --policy write their own text listing\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(diff)
+    {
+        if((argc - optind != 2) || (pack_size > 0) || (files_from != NULL) ||
+           (build_index != NULL) || (matches.count > 0) ||
+           (manifest_path != NULL))
+        {
+            fprintf(stderr, "--diff compares two dump files or two directories\n");
+            exit(DIFF_TROUBLE);
+        }
+        init_colors();
+        return diff_inputs(argv[optind], argv[optind + 1]);
+    }
+
+    if(index_path != NULL)
+    {
+        if((query_key == NULL) && (top_keys == 0))
+        {
+            fprintf(stderr, "The index can be queried by --key or --top\n");
+            exit(EXIT_FAILURE);
+        }
+        return query_index();
+    }
+    if((query_key != NULL) || (top_keys > 0))
+    {
+        fprintf(stderr, "--key and --top query the --index\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(audit_path != NULL)
+    {
+        unsigned long line;
+
+        if(key_set_load(&audit_keys, audit_path, &line) != 0)
+        {
+            if(errno == EINVAL)
+            {
+                fprintf(stderr, "%s:%lu: not a key of 12 hex digits\n",
+                        audit_path, line);
+            }
+            else
+            {
+                fprintf(stderr, "Error reading the dictionary %s: %s\n",
+                        audit_path, strerror(errno));
+            }
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(policy_path != NULL)
+    {
+        unsigned long line;
+
+        if(policy_load(&policy, policy_path, &line) != 0)
+        {
+            if(errno == EINVAL)
+            {
+                fprintf(stderr, "%s:%lu: not a valid rule\n", policy_path,
+                        line);
+            }
+            else
+            {
+                fprintf(stderr, "Error reading the policy %s: %s\n",
+                        policy_path, strerror(errno));
+            }
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if((serve_root != NULL) && (serve_path == NULL))
+    {
+        fprintf(stderr, "--serve-root is an option of --serve\n");
+        exit(EXIT_FAILURE);
+    }
+    if(serve_path != NULL)
+    {
+        if(stream || (build_index != NULL) || (cache_path != NULL) ||
+           (manifest_path != NULL) || (optind < argc) || (files_from != NULL))
+        {
+            fprintf(stderr, "--serve takes the dumps from the socket only\n");
+            exit(EXIT_FAILURE);
+        }
+        if(serve_run(serve_path, jobs, serve_request) != 0)
+        {
+            fprintf(stderr, "Error serving on %s: %s\n", serve_path,
+                    (errno == ENOSYS) ? "not supported on this system"
+                                      : strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        return EXIT_FAILURE;
+    }
+
+    if(stream && (manifest_path != NULL))
+    {
+        fprintf(stderr, "--manifest keeps the files of the batch mode only\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(stream && (pack_size == 0))
+    {
+        fprintf(stderr, "Size of the dumps must be given by --size in the stream mode\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(stream && (optind == argc) && (files_from == NULL))
+    {
+        /* the stream is read from stdin by default */
+        append_input(&inputs, "-");
+    }
+    else if((optind == argc) && (files_from == NULL))
+    {
+        fprintf(stderr, "No input file has been specified\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* headers and summaries are shown whenever more dumps can be printed */
+    if(argc - optind > 1)
+    {
+        batch = true;
+    }
+
+    for(; optind < argc; optind++)
+    {
+        if(add_input_path(&inputs, argv[optind]) != 0)
+        {
+            failed++;
+        }
+    }
+
+    if(files_from != NULL)
+    {
+        if(read_input_list(&inputs, files_from, &failed) != 0)
+        {
+            exit(EXIT_FAILURE);
+        }
+        batch = true;
+    }
+
+    init_colors();
+
+#ifdef _WIN32
+    if(fmt.format == FORMAT_BINARY)
+    {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
+    /* more JSON objects are written as items of an array */
+    fmt.json_array = batch && (fmt.format == FORMAT_JSON) &&
+                     (build_index == NULL);
+
+    if(cache_path != NULL)
+    {
+        if((cache_init(&cache) != 0) || (cache_load(&cache, cache_path) != 0))
+        {
+            fprintf(stderr, "Error reading the cache %s: %s\n", cache_path,
+                    (errno == EINVAL) ? "not a valid cache" : strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(manifest_path != NULL)
+    {
+        if((manifest_init(&manifest, manifest_fingerprint()) != 0) ||
+           (manifest_load(&manifest, manifest_path) != 0))
+        {
+            fprintf(stderr, "Error reading the manifest %s: %s\n",
+                    manifest_path,
+                    (errno == EINVAL) ? "not a valid manifest"
+                                      : strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if(build_index != NULL)
+        {
+            /* a file is kept only with its dumps in the last index, so all
+               the files are parsed again when it cannot be read */
+            last_index_open = (index_open(build_index, &last_index) == 0);
+            if(!last_index_open)
+            {
+                uint32_t fingerprint = manifest.fingerprint;
+
+                manifest_free(&manifest);
+                if(manifest_init(&manifest, fingerprint) != 0)
+                {
+                    fprintf(stderr, "Error reading the manifest %s: %s\n",
+                            manifest_path, strerror(errno));
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        if(skip_unchanged(&inputs) != 0)
+        {
+            fprintf(stderr, "Error checking the manifest %s: %s\n",
+                    manifest_path, strerror(ENOMEM));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(batch)
+    {
+        /* the dumps are written as whole blocks, so let stdio pass them to
+           the system in big chunks */
+        setvbuf(stdout, NULL, _IOFBF, BATCH_STDOUT_BUFFER);
+    }
+
+    if(stream)
+    {
+        for(i = 0; i < inputs.count; i++)
+        {
+            if(process_stream(inputs.paths[i]) != 0)
+            {
+                failed++;
+            }
+        }
+    }
+    else if((jobs > 1) && (inputs.count > 1) && (build_index == NULL))
+    {
+        failed += process_parallel(&inputs, jobs);
+    }
+    else
+    {
+        failed += process_sequential(&inputs);
+    }
+
+    for(i = 0; i < inputs.count; i++)
+    {
+        free(inputs.paths[i]);
+    }
+    free(inputs.paths);
+
+    if(cache_path != NULL)
+    {
+        if(verbose > 0)
+        {
+            fprintf(stderr, "Cache: %lu hits, %lu misses, %lu entries\n",
+                    cache.hits, cache.misses, (unsigned long)cache.count);
+        }
+        if((cache.stored > 0) && (cache_save(&cache, cache_path) != 0))
+        {
+            fprintf(stderr, "Error writing the cache %s: %s\n", cache_path,
+                    strerror(errno));
+        }
+        cache_free(&cache);
+    }
+
+    if(build_index != NULL)
+    {
+        if((manifest_path != NULL) && (update_index() != 0))
+        {
+            fprintf(stderr, "Error updating the index %s: %s\n", build_index,
+                    strerror(errno));
+            index_failed = true;
+        }
+        else if(index_write(&index_builder, build_index) != 0)
+        {
+            fprintf(stderr, "Error writing the index %s: %s\n", build_index,
+                    strerror(errno));
+            index_failed = true;
+        }
+        if(index_failed)
+        {
+            failed++;
+        }
+        index_free(&index_builder);
+    }
+    else if(fmt.json_array)
+    {
+        fputs((json_items > 0) ? "]\n" : "[]\n", stdout);
+    }
+
+    if(audit_path != NULL)
+    {
+        fflush(stdout);
+        fprintf(stderr, "Audit: %lu sectors of %lu dumps use %lu known keys\n",
+                audit_sectors, audit_dumps, (unsigned long)audit_keys.count);
+        key_set_free(&audit_keys);
+    }
+
+    if(policy_path != NULL)
+    {
+        fflush(stdout);
+        fprintf(stderr, "Policy: %lu violations in %lu dumps, %lu rules\n",
+                policy_violations, policy_dumps, (unsigned long)policy.count);
+        policy_free(&policy);
+    }
+
+    if(manifest_path != NULL)
+    {
+        fflush(stdout);
+        fprintf(stderr, "Manifest: %lu files unchanged, %lu updated\n",
+                manifest.unchanged, manifest.updated);
+        /* the files of an index not written are parsed again next time */
+        if(!index_failed && (manifest_save(&manifest, manifest_path) != 0))
+        {
+            fprintf(stderr, "Error writing the manifest %s: %s\n",
+                    manifest_path, strerror(errno));
+        }
+        manifest_free(&manifest);
+    }
+
+    if(matches.count > 0)
+    {
+        if(verbose > 0)
+        {
+            fflush(stdout);
+            fprintf(stderr, "Match: %lu dumps\n", matched_dumps);
+        }
+        match_free(&matches);
+    }
+
+    if(verbose > 0)
+    {
+        fflush(stdout);
+        stats_report(&run_stats, stderr, verbose);
+    }
+    stats_free(&run_stats);
+
+    if(batch)
+    {
+        fprintf(stderr, "%u files processed, %u failed\n",
+                (unsigned)inputs.count, failed);
+    }
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
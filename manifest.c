@@ -0,0 +1,440 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Manifest of the parsed dump files
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "manifest.h"
+#include "mfd.h"
+#include "replace.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+#define MANIFEST_BYTE_ORDER 0x01020304u
+#define MANIFEST_INITIAL    1024u
+/* longest path accepted from the manifest file */
+#define MANIFEST_PATH_MAX   4096u
+
+/**************************************************************************//**
+ *                              PRIVATE TYPES
+ *****************************************************************************/
+/* Layout of the manifest file, in the byte order of the host which has
+   written it: the header, then every file as a record followed by its path
+   without the terminating NUL. */
+struct manifest_header
+{
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t fingerprint;
+    uint64_t count;
+};
+
+struct manifest_record
+{
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+    uint32_t path_len;
+    uint32_t reserved;
+};
+
+/**************************************************************************//**
+ *                          PRIVATE VARIABLES
+ *****************************************************************************/
+static const char manifest_magic[8] = { 'M', 'F', 'D', 'M', 'A', 'N', 0, 1 };
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Returns the slot holding the file, or the empty slot where it would be
+ * stored. The table is never full.
+ *****************************************************************************/
+static size_t find_slot(const struct manifest_entry *slots, size_t capacity,
+                        const char *path)
+{
+    size_t mask = capacity - 1u;
+    size_t s = (size_t)(mfd_xxh64((const uint8_t *)path, strlen(path)) >> 8)
+               & mask;
+
+    while((slots[s].path != NULL) && (strcmp(slots[s].path, path) != 0))
+    {
+        s = (s + 1u) & mask;
+    }
+
+    return s;
+}
+
+/**************************************************************************//**
+ * Doubles the hash table when it is half full.
+ *****************************************************************************/
+static int grow_table(struct manifest *m)
+{
+    struct manifest_entry *slots;
+    size_t capacity;
+    size_t i;
+
+    if(m->count + 1u <= m->capacity / 2u)
+    {
+        return 0;
+    }
+
+    capacity = m->capacity * 2u;
+    slots = calloc(capacity, sizeof(*slots));
+    if(slots == NULL)
+    {
+        return -1;
+    }
+    for(i = 0; i < m->capacity; i++)
+    {
+        if(m->slots[i].path != NULL)
+        {
+            slots[find_slot(slots, capacity, m->slots[i].path)] = m->slots[i];
+        }
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->capacity = capacity;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Returns the entry of the file, adding a pending one with a copy of the path
+ * if the manifest does not have it yet. Returns NULL on out of memory.
+ *****************************************************************************/
+static struct manifest_entry *insert(struct manifest *m, const char *path,
+                                     size_t path_len)
+{
+    struct manifest_entry *e;
+
+    if(grow_table(m) != 0)
+    {
+        return NULL;
+    }
+    e = &m->slots[find_slot(m->slots, m->capacity, path)];
+    if(e->path != NULL)
+    {
+        return e;
+    }
+
+    memset(e, 0, sizeof(*e));
+    e->state = MANIFEST_PENDING;
+    e->path = malloc(path_len + 1u);
+    if(e->path == NULL)
+    {
+        return NULL;
+    }
+    memcpy(e->path, path, path_len + 1u);
+    m->count++;
+
+    return e;
+}
+
+/**************************************************************************//**
+ * Returns the entry of the file or NULL if the manifest does not have it.
+ *****************************************************************************/
+static struct manifest_entry *find(struct manifest *m, const char *path)
+{
+    struct manifest_entry *e = &m->slots[find_slot(m->slots, m->capacity,
+                                                   path)];
+
+    return (e->path != NULL) ? e : NULL;
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Prepares an empty manifest.
+ *****************************************************************************/
+int manifest_init(struct manifest *m, uint32_t fingerprint)
+{
+    memset(m, 0, sizeof(*m));
+    m->fingerprint = fingerprint;
+    m->capacity = MANIFEST_INITIAL;
+    m->slots = calloc(m->capacity, sizeof(*m->slots));
+    if(m->slots == NULL)
+    {
+        return -1;
+    }
+    pthread_mutex_init(&m->lock, NULL);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Releases all the entries.
+ *****************************************************************************/
+void manifest_free(struct manifest *m)
+{
+    size_t i;
+
+    for(i = 0; i < m->capacity; i++)
+    {
+        free(m->slots[i].path);
+    }
+    free(m->slots);
+    pthread_mutex_destroy(&m->lock);
+    memset(m, 0, sizeof(*m));
+}
+
+/**************************************************************************//**
+ * Adds the files of the manifest file, all of them stale until they are
+ * checked. A missing file is an empty manifest and so is a file written with
+ * other options than the fingerprint of the manifest tells, as its outputs
+ * would not match those of this run. Returns -1 and sets errno on failure,
+ * EINVAL if the file is not a manifest.
+ *****************************************************************************/
+int manifest_load(struct manifest *m, const char *path)
+{
+    struct manifest_header h;
+    char name[MANIFEST_PATH_MAX + 1u];
+    uint64_t i;
+    FILE *fp;
+    int r = 0;
+
+    fp = fopen(path, "rb");
+    if(fp == NULL)
+    {
+        return (errno == ENOENT) ? 0 : -1;
+    }
+
+    if((fread(&h, sizeof(h), 1, fp) != 1) ||
+       (memcmp(h.magic, manifest_magic, sizeof(manifest_magic)) != 0) ||
+       (h.byte_order != MANIFEST_BYTE_ORDER))
+    {
+        fclose(fp);
+        errno = EINVAL;
+        return -1;
+    }
+    if(h.fingerprint != m->fingerprint)
+    {
+        fclose(fp);
+        return 0;
+    }
+
+    for(i = 0; i < h.count; i++)
+    {
+        struct manifest_record rec;
+        struct manifest_entry *e;
+
+        if((fread(&rec, sizeof(rec), 1, fp) != 1) ||
+           (rec.path_len == 0) || (rec.path_len > MANIFEST_PATH_MAX) ||
+           (fread(name, 1, rec.path_len, fp) != rec.path_len) ||
+           (memchr(name, '\0', rec.path_len) != NULL))
+        {
+            errno = EINVAL;
+            r = -1;
+            break;
+        }
+        name[rec.path_len] = '\0';
+        e = insert(m, name, rec.path_len);
+        if(e == NULL)
+        {
+            errno = ENOMEM;
+            r = -1;
+            break;
+        }
+        e->size = rec.size;
+        e->mtime = rec.mtime;
+        e->hash = rec.hash;
+        e->state = MANIFEST_STALE;
+    }
+
+    fclose(fp);
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Writes the files kept or parsed by this run to the manifest file. The stale
+ * files are dropped and so are the failed ones, which are parsed again by
+ * the next run. Returns -1 and sets errno on failure.
+ *****************************************************************************/
+int manifest_save(struct manifest *m, const char *path)
+{
+    struct manifest_header h;
+    size_t i;
+    char *tmp_path;
+    FILE *fp;
+    int r = 0;
+
+    fp = replace_open(path, &tmp_path);
+    if(fp == NULL)
+    {
+        return -1;
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, manifest_magic, sizeof(manifest_magic));
+    h.byte_order = MANIFEST_BYTE_ORDER;
+    h.fingerprint = m->fingerprint;
+    for(i = 0; i < m->capacity; i++)
+    {
+        unsigned state = m->slots[i].state;
+
+        if((m->slots[i].path != NULL) &&
+           ((state == MANIFEST_KEPT) || (state == MANIFEST_DONE)))
+        {
+            h.count++;
+        }
+    }
+    if(fwrite(&h, sizeof(h), 1, fp) != 1)
+    {
+        r = -1;
+    }
+
+    for(i = 0; (i < m->capacity) && (r == 0); i++)
+    {
+        const struct manifest_entry *e = &m->slots[i];
+        struct manifest_record rec;
+
+        if((e->path == NULL) ||
+           ((e->state != MANIFEST_KEPT) && (e->state != MANIFEST_DONE)))
+        {
+            continue;
+        }
+        memset(&rec, 0, sizeof(rec));
+        rec.size = e->size;
+        rec.mtime = e->mtime;
+        rec.hash = e->hash;
+        rec.path_len = (uint32_t)strlen(e->path);
+        if((fwrite(&rec, sizeof(rec), 1, fp) != 1) ||
+           (fwrite(e->path, 1, rec.path_len, fp) != rec.path_len))
+        {
+            r = -1;
+        }
+    }
+
+    return replace_close(fp, path, tmp_path, r);
+}
+
+/**************************************************************************//**
+ * Checks the input file against the manifest before the dumps are parsed,
+ * from one thread only. Returns 1 if the file has the size and the time of
+ * modification recorded by the last run, so it does not need to be parsed
+ * again, 0 if it is new or modified and -1 on out of memory.
+ *****************************************************************************/
+int manifest_check(struct manifest *m, const char *path, uint64_t size,
+                   int64_t mtime)
+{
+    struct manifest_entry *e;
+    size_t path_len = strlen(path);
+
+    if(path_len > MANIFEST_PATH_MAX)
+    {
+        /* too long to be saved, so it is always parsed */
+        return 0;
+    }
+
+    e = insert(m, path, path_len);
+    if(e == NULL)
+    {
+        return -1;
+    }
+    if(e->state == MANIFEST_KEPT)
+    {
+        return 1;
+    }
+    if((e->state == MANIFEST_STALE) && (e->size == size) &&
+       (e->mtime == mtime))
+    {
+        e->state = MANIFEST_KEPT;
+        m->unchanged++;
+        return 1;
+    }
+
+    /* the hash of the same size may still tell that only the time changed */
+    if(e->size != size)
+    {
+        e->hash = 0;
+    }
+    e->size = size;
+    e->mtime = mtime;
+    e->state = MANIFEST_PENDING;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Checks the contents of a modified file read for parsing. Returns true, and
+ * keeps the file, if the hash of its contents is the one recorded by the last
+ * run, so only the time of modification has changed.
+ *****************************************************************************/
+bool manifest_same_hash(struct manifest *m, const char *path, uint64_t hash)
+{
+    struct manifest_entry *e;
+    bool same = false;
+
+    pthread_mutex_lock(&m->lock);
+    e = find(m, path);
+    if((e != NULL) && (e->state == MANIFEST_PENDING) && (hash != 0) &&
+       (e->hash == hash))
+    {
+        e->state = MANIFEST_KEPT;
+        m->unchanged++;
+        same = true;
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    return same;
+}
+
+/**************************************************************************//**
+ * Records the file parsed without errors with the hash of its contents, 0 if
+ * it has not been read whole.
+ *****************************************************************************/
+void manifest_done(struct manifest *m, const char *path, uint64_t hash)
+{
+    struct manifest_entry *e;
+
+    pthread_mutex_lock(&m->lock);
+    e = find(m, path);
+    if((e != NULL) && (e->state == MANIFEST_PENDING))
+    {
+        e->hash = hash;
+        e->state = MANIFEST_DONE;
+        m->updated++;
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+/**************************************************************************//**
+ * Returns true if the file has not changed since the last run, so its
+ * results from that run are still valid.
+ *****************************************************************************/
+bool manifest_kept(struct manifest *m, const char *path)
+{
+    const struct manifest_entry *e;
+    bool kept;
+
+    pthread_mutex_lock(&m->lock);
+    e = find(m, path);
+    kept = (e != NULL) && (e->state == MANIFEST_KEPT);
+    pthread_mutex_unlock(&m->lock);
+
+    return kept;
+}
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Manifest of the dump files parsed by an earlier run. It keeps the size, the
+ * modification time and a hash of the contents of every file, so a batch run
+ * over a growing corpus parses only the new and modified dumps.
+ *****************************************************************************/
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* states of the files of the manifest */
+#define MANIFEST_STALE      0   /* loaded but not among the inputs */
+#define MANIFEST_KEPT       1   /* not changed since the run which wrote it */
+#define MANIFEST_PENDING    2   /* new or modified, to be parsed */
+#define MANIFEST_DONE       3   /* parsed by this run */
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* one file, an empty slot has no path */
+struct manifest_entry
+{
+    char *path;
+    uint64_t size;
+    int64_t mtime;              /* nanoseconds since the epoch */
+    uint64_t hash;              /* XXH64 of the contents, 0 if unknown */
+    unsigned state;
+};
+
+/* open addressing hash table of the files by their paths, the states are
+   shared by the worker threads */
+struct manifest
+{
+    struct manifest_entry *slots;
+    size_t count;
+    size_t capacity;            /* power of two */
+    uint32_t fingerprint;       /* options of the run which wrote the files */
+    unsigned long unchanged;
+    unsigned long updated;
+    pthread_mutex_t lock;
+};
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int manifest_init(struct manifest *m, uint32_t fingerprint);
+void manifest_free(struct manifest *m);
+int manifest_load(struct manifest *m, const char *path);
+int manifest_save(struct manifest *m, const char *path);
+
+int manifest_check(struct manifest *m, const char *path, uint64_t size,
+                   int64_t mtime);
+bool manifest_same_hash(struct manifest *m, const char *path, uint64_t hash);
+void manifest_done(struct manifest *m, const char *path, uint64_t hash);
+bool manifest_kept(struct manifest *m, const char *path);
+
+#endif /* MANIFEST_H */
@@ -0,0 +1,404 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Filter of the dumps by --match expressions
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "match.h"
+#include "ranges.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* most words of an expression */
+#define MATCH_WORDS         8u
+
+/* selections of a term covering the whole dump */
+#define ALL_BLOCKS          0xffffu
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Splits the expression to words separated by blanks. Returns the number of
+ * words, or MATCH_WORDS + 1 if there are more.
+ *****************************************************************************/
+static unsigned split_words(char *text, char **words)
+{
+    unsigned n = 0;
+
+    for(;;)
+    {
+        text += strspn(text, " \t");
+        if(*text == '\0')
+        {
+            return n;
+        }
+        if(n == MATCH_WORDS)
+        {
+            return n + 1u;
+        }
+        words[n++] = text;
+        text += strcspn(text, " \t");
+        if(*text == '\0')
+        {
+            return n;
+        }
+        *text++ = '\0';
+    }
+}
+
+/**************************************************************************//**
+ * Returns the value of the hex digit or -1 for another character.
+ *****************************************************************************/
+static int hex_digit(char c)
+{
+    if((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    if((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+    if((c >= 'A') && (c <= 'F'))
+    {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/**************************************************************************//**
+ * Parses the byte pattern given by pairs of hex digits. Returns -1 for an
+ * empty, odd or too long pattern.
+ *****************************************************************************/
+static int parse_pattern(const char *text, struct match_term *term)
+{
+    size_t len = strlen(text);
+    size_t i;
+
+    if((len == 0) || (len % 2u != 0) || (len > 2u * MATCH_PATTERN_MAX))
+    {
+        return -1;
+    }
+    for(i = 0; i < len; i += 2u)
+    {
+        int hi = hex_digit(text[i]);
+        int lo = hex_digit(text[i + 1u]);
+
+        if((hi < 0) || (lo < 0))
+        {
+            return -1;
+        }
+        term->pattern[i / 2u] = (uint8_t)((hi << 4) | lo);
+    }
+    term->len = len / 2u;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Returns the card type of the name, Mini, 1K, 2K or 4K in any case, or
+ * MFD_CARD_UNKNOWN.
+ *****************************************************************************/
+static unsigned parse_card(const char *text)
+{
+    unsigned type;
+
+    for(type = MFD_CARD_MINI; type <= MFD_CARD_4K; type++)
+    {
+        const char *name = mfd_card_name(type);
+        size_t i = 0;
+
+        while((name[i] != '\0') && (tolower((unsigned char)text[i]) ==
+                                    tolower((unsigned char)name[i])))
+        {
+            i++;
+        }
+        if((name[i] == '\0') && (text[i] == '\0'))
+        {
+            return type;
+        }
+    }
+
+    return MFD_CARD_UNKNOWN;
+}
+
+/**************************************************************************//**
+ * Compiles the words of one expression. Returns -1 for a wrong expression.
+ *****************************************************************************/
+static int compile_term(char **words, unsigned n, struct match_term *term)
+{
+    unsigned i = 0;
+    uint64_t mask;
+
+    memset(term, 0, sizeof(*term));
+    term->sectors = MFD_ALL_SECTORS;
+    term->blocks = ALL_BLOCKS;
+
+    if((n > 0) && (strcmp(words[0], "not") == 0))
+    {
+        term->negate = true;
+        i++;
+    }
+    if(i + 2u > n)
+    {
+        return -1;
+    }
+
+    if(strcmp(words[i], "card") == 0)
+    {
+        term->field = MATCH_CARD;
+        term->card = parse_card(words[i + 1u]);
+        return ((term->card != MFD_CARD_UNKNOWN) && (i + 2u == n)) ? 0 : -1;
+    }
+    if(parse_pattern(words[i + 1u], term) != 0)
+    {
+        return -1;
+    }
+    if(strcmp(words[i], "uid") == 0)
+    {
+        term->field = MATCH_UID;
+        return ((term->len <= 7u) && (i + 2u == n)) ? 0 : -1;
+    }
+    if(strcmp(words[i], "sak") == 0)
+    {
+        term->field = MATCH_SAK;
+        return ((term->len == 1u) && (i + 2u == n)) ? 0 : -1;
+    }
+    if(strcmp(words[i], "atqa") == 0)
+    {
+        term->field = MATCH_ATQA;
+        return ((term->len == 2u) && (i + 2u == n)) ? 0 : -1;
+    }
+    if(strcmp(words[i], "bytes") != 0)
+    {
+        return -1;
+    }
+
+    term->field = MATCH_BYTES;
+    for(i += 2u; i + 2u <= n; i += 2u)
+    {
+        if(strcmp(words[i], "sectors") == 0)
+        {
+            if(parse_ranges(words[i + 1u], MFD_MAX_SECTORS,
+                            &term->sectors) != 0)
+            {
+                return -1;
+            }
+        }
+        else if((strcmp(words[i], "blocks") == 0) &&
+                (parse_ranges(words[i + 1u], 16u, &mask) == 0))
+        {
+            term->blocks = (uint16_t)mask;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    return (i == n) ? 0 : -1;
+}
+
+/**************************************************************************//**
+ * Checks whether the pattern is found in the bytes. Candidates are found by
+ * memchr(), which the C library runs by vector instructions, and compared
+ * whole only then.
+ *****************************************************************************/
+static bool find_bytes(const uint8_t *data, size_t len,
+                       const uint8_t *pattern, size_t pattern_len)
+{
+    while(len >= pattern_len)
+    {
+        const uint8_t *p = memchr(data, pattern[0], len - pattern_len + 1u);
+
+        if(p == NULL)
+        {
+            return false;
+        }
+        if(memcmp(p + 1, pattern + 1, pattern_len - 1u) == 0)
+        {
+            return true;
+        }
+        len -= (size_t)(p + 1 - data);
+        data = p + 1;
+    }
+
+    return false;
+}
+
+/**************************************************************************//**
+ * Searches the pattern of the term in the selected blocks. Runs of adjacent
+ * selected blocks are searched as one, so a pattern may span them.
+ *****************************************************************************/
+static bool search_blocks(const struct match_term *term,
+                          const struct mfd_dump *info)
+{
+    size_t run_start = 0;
+    size_t run_end = 0;
+    unsigned sector, block;
+
+    if((term->sectors == MFD_ALL_SECTORS) && (term->blocks == ALL_BLOCKS))
+    {
+        return find_bytes(info->data, info->data_size, term->pattern,
+                          term->len);
+    }
+
+    for(sector = 0; sector < info->sectors; sector++)
+    {
+        const struct mfd_sector *si = &info->sector[sector];
+
+        if(!(term->sectors & ((uint64_t)1 << sector)))
+        {
+            continue;
+        }
+        for(block = 0; block < si->blocks; block++)
+        {
+            size_t offset = si->start + block * MFD_BLOCK_SIZE;
+
+            if(!(term->blocks & (1u << block)))
+            {
+                continue;
+            }
+            if(offset != run_end)
+            {
+                if(find_bytes(&info->data[run_start], run_end - run_start,
+                              term->pattern, term->len))
+                {
+                    return true;
+                }
+                run_start = offset;
+            }
+            run_end = offset + MFD_BLOCK_SIZE;
+        }
+    }
+
+    return find_bytes(&info->data[run_start], run_end - run_start,
+                      term->pattern, term->len);
+}
+
+/**************************************************************************//**
+ * Checks the term on the dump, the negation left out.
+ *****************************************************************************/
+static bool term_holds(const struct match_term *term,
+                       const struct mfd_dump *info)
+{
+    const uint8_t *data = info->data;
+    unsigned sak = info->card.sak_offset;
+
+    switch(term->field)
+    {
+    case MATCH_UID:
+        return (term->len <= info->card.uid_len) &&
+               (memcmp(data, term->pattern, term->len) == 0);
+    case MATCH_SAK:
+        return data[sak] == term->pattern[0];
+    case MATCH_ATQA:
+        return memcmp(&data[sak + 1u], term->pattern, 2) == 0;
+    case MATCH_CARD:
+        return info->card.type == term->card;
+    default:
+        return search_blocks(term, info);
+    }
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Compiles the expression and adds it to the terms which must all hold.
+ * Returns -1 and sets errno on failure, EINVAL for a wrong expression.
+ *****************************************************************************/
+int match_add(struct match *match, const char *expression)
+{
+    char *words[MATCH_WORDS];
+    struct match_term *terms;
+    char *copy = malloc(strlen(expression) + 1u);
+    unsigned n;
+    int r;
+
+    if(copy == NULL)
+    {
+        return -1;
+    }
+    strcpy(copy, expression);
+    n = split_words(copy, words);
+
+    terms = realloc(match->terms, (match->count + 1u) * sizeof(*terms));
+    if(terms == NULL)
+    {
+        free(copy);
+        return -1;
+    }
+    match->terms = terms;
+
+    r = ((n <= MATCH_WORDS) &&
+         (compile_term(words, n, &terms[match->count]) == 0)) ? 0 : -1;
+    free(copy);
+    if(r != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    match->count++;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Releases the compiled terms.
+ *****************************************************************************/
+void match_free(struct match *match)
+{
+    free(match->terms);
+    match->terms = NULL;
+    match->count = 0;
+}
+
+/**************************************************************************//**
+ * Checks whether all the terms hold for the dump of data_size bytes. Just
+ * the geometry and block 0 are decoded, none of the trailers.
+ *****************************************************************************/
+bool match_dump(const struct match *match, const uint8_t *data,
+                size_t data_size)
+{
+    struct mfd_dump info;
+    size_t i;
+
+    if(mfd_decode_selected(data, data_size, 0, &info) != MFD_OK)
+    {
+        return false;
+    }
+    for(i = 0; i < match->count; i++)
+    {
+        if(term_holds(&match->terms[i], &info) == match->terms[i].negate)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Filter of the dumps by --match expressions over the manufacturer block and
+ * byte patterns in the blocks. The expressions are compiled once and checked
+ * on the raw dump before it is decoded or rendered, so the dumps left out
+ * cost a search in their bytes only.
+ *****************************************************************************/
+#ifndef MATCH_H
+#define MATCH_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mfd.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* fields compared by a term */
+#define MATCH_UID           0
+#define MATCH_SAK           1
+#define MATCH_ATQA          2
+#define MATCH_CARD          3
+#define MATCH_BYTES         4
+
+/* longest byte pattern */
+#define MATCH_PATTERN_MAX   64u
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* one compiled expression: UID starting by the pattern, SAK or ATQA equal
+   to it, the card type, or the pattern found in the selected blocks */
+struct match_term
+{
+    int field;
+    bool negate;
+    unsigned card;              /* MFD_CARD_... of MATCH_CARD */
+    uint64_t sectors;           /* bit x for sector x */
+    uint16_t blocks;            /* bit x for block x of every sector */
+    size_t len;
+    uint8_t pattern[MATCH_PATTERN_MAX];
+};
+
+/* expressions all of which must hold */
+struct match
+{
+    struct match_term *terms;
+    size_t count;
+};
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int match_add(struct match *match, const char *expression);
+void match_free(struct match *match);
+bool match_dump(const struct match *match, const uint8_t *data,
+                size_t data_size);
+
+#endif /* MATCH_H */
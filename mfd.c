@@ -0,0 +1,903 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * libmfdread: decoder of Mifare Classic dumps
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <string.h>
+#include "mfd.h"
+#if defined(MFD_DISPATCH_AVX2)
+#   include <immintrin.h>
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#   include <arm_neon.h>
+#endif
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* C1x C2x C3x of block x from the 12 bits C1[3:0] C2[7:4] C3[11:8] */
+#define ACCESS_COND(i, x) (((((i) >> (x)) & 1) << 2) | \
+                           ((((i) >> ((x) + 4)) & 1) << 1) | \
+                           (((i) >> ((x) + 8)) & 1))
+#define ACCESS_ENTRY(i) (ACCESS_COND(i, 0) | (ACCESS_COND(i, 1) << 3) | \
+                         (ACCESS_COND(i, 2) << 6) | (ACCESS_COND(i, 3) << 9)),
+
+#define XXH_PRIME64_1       UINT64_C(0x9E3779B185EBCA87)
+#define XXH_PRIME64_2       UINT64_C(0xC2B2AE3D27D4EB4F)
+#define XXH_PRIME64_3       UINT64_C(0x165667B19E3779F9)
+#define XXH_PRIME64_4       UINT64_C(0x85EBCA77C2B2AE63)
+#define XXH_PRIME64_5       UINT64_C(0x27D4EB2F165667C5)
+
+/**************************************************************************//**
+ *                              PRIVATE VARIABLES
+ *****************************************************************************/
+/* access conditions of the four blocks, three bits each, for all the values
+   of the access bits C1 C2 C3 gathered by mfd_decode_access_bits() */
+static const uint16_t access_table[4096] =
+{
+    MFD_REPEAT4096(ACCESS_ENTRY, 0)
+};
+
+/* access to a data block by the access bits C1 C2 C3 of its group,
+   increment and decrement of the value blocks are left out */
+static const uint8_t data_access[8] =
+{
+    MFD_READ_A | MFD_READ_B | MFD_WRITE_A | MFD_WRITE_B,    /* 000 */
+    MFD_READ_A | MFD_READ_B,                                /* 001 */
+    MFD_READ_A | MFD_READ_B,                                /* 010 */
+    MFD_READ_B | MFD_WRITE_B,                               /* 011 */
+    MFD_READ_A | MFD_READ_B | MFD_WRITE_B,                  /* 100 */
+    MFD_READ_B,                                             /* 101 */
+    MFD_READ_A | MFD_READ_B | MFD_WRITE_B,                  /* 110 */
+    0                                                       /* 111 */
+};
+
+/* access to the sector trailer by its access bits C1 C2 C3: a read is the
+   read of key B, a write rewrites the keys or the access bits */
+static const uint8_t trailer_access[8] =
+{
+    MFD_READ_A | MFD_WRITE_A,                               /* 000 */
+    MFD_READ_A | MFD_WRITE_A,                               /* 001 */
+    MFD_READ_A,                                             /* 010 */
+    MFD_WRITE_B,                                            /* 011 */
+    MFD_WRITE_B,                                            /* 100 */
+    MFD_WRITE_B,                                            /* 101 */
+    0,                                                      /* 110 */
+    0                                                       /* 111 */
+};
+
+/* trailer of an untouched sector: default keys and transport configuration */
+static const uint8_t default_trailer[16] =
+{
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x07, 0x80, 0x69,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+/**************************************************************************//**
+ * Decodes the access bits of a sector trailer for all four blocks at once.
+ * The access bits C1 C2 C3 and the inverted ones are gathered to 12 bit
+ * words, the conditions are then looked up in access_table and compared
+ * against the inverted bits for all the blocks by a few bit operations.
+ *****************************************************************************/
+void mfd_decode_access_bits(const uint8_t *access_bits, struct mfd_access *ac)
+{
+    /* C1[3:0] C2[7:4] C3[11:8], the same order as the inverted bits */
+    unsigned bits = (access_bits[1] >> 4) | ((unsigned)access_bits[2] << 4);
+    unsigned inverted = access_bits[0] | ((access_bits[1] & 0x0fu) << 8);
+    unsigned conditions = access_table[bits];
+    /* set for all the bits not matching the inverted ones */
+    unsigned errors = (bits ^ ~inverted) & 0x0fffu;
+
+    ac->cond[0] = conditions & 0x07u;
+    ac->cond[1] = (conditions >> 3) & 0x07u;
+    ac->cond[2] = (conditions >> 6) & 0x07u;
+    ac->cond[3] = (conditions >> 9) & 0x07u;
+    ac->valid = ~(errors | (errors >> 4) | (errors >> 8)) & 0x0fu;
+}
+
+/**************************************************************************//**
+ * Returns index of the access conditions in the trailer used by the block.
+ *****************************************************************************/
+unsigned mfd_access_group(unsigned sector, unsigned block)
+{
+    if(sector >= 32)
+    {
+        /* Mifare 4k uses access rights in clusters of 5 blocks each for sectors
+           in a range 32 to 39. */
+        return block / 5;
+    }
+
+    return block;
+}
+
+/**************************************************************************//**
+ * Returns the three access bits of the block decoded from the trailer of its
+ * sector or -1 if the inverted bits do not match the access bits.
+ *****************************************************************************/
+int mfd_block_condition(const struct mfd_access *ac, unsigned sector,
+                        unsigned block)
+{
+    unsigned group = mfd_access_group(sector, block);
+
+    if((group > 3) || !(ac->valid & (1u << group)))
+    {
+        return -1;
+    }
+
+    return ac->cond[group];
+}
+
+/**************************************************************************//**
+ * Decodes the access bit string for specific block.
+ * Returns the three access bits for the block or -1 if the inverted bits do
+ * not match the access bits.
+ *****************************************************************************/
+int mfd_get_access_condition(unsigned sector, unsigned block,
+                             const uint8_t *access_bits)
+{
+    struct mfd_access ac;
+
+    mfd_decode_access_bits(access_bits, &ac);
+
+    return mfd_block_condition(&ac, sector, block);
+}
+
+/**************************************************************************//**
+ * Returns offset of the sector in the dump and its number of blocks.
+ *****************************************************************************/
+unsigned mfd_sector_layout(unsigned sector, unsigned *blocks)
+{
+    if(sector < 32u)
+    {
+        *blocks = 4u;
+        return sector * 4u * 16u;
+    }
+
+    *blocks = 16u;
+    return 2048u + (sector - 32u) * 16u * 16u;
+}
+
+/**************************************************************************//**
+ * Checks whether the sector is untouched since the production: all the data
+ * blocks are zero and the trailer holds the default keys and the transport
+ * configuration. The blocks are compared 16 bytes at a time.
+ *****************************************************************************/
+bool mfd_sector_is_default(const uint8_t *sector, unsigned blocks)
+{
+    const uint8_t *trailer = &sector[(blocks - 1u) * 16u];
+    unsigned block;
+
+#if defined(__SSE2__)
+    __m128i data = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    __m128i expected = _mm_loadu_si128((const __m128i *)default_trailer);
+
+    for(block = 0; block < blocks - 1u; block++)
+    {
+        data = _mm_or_si128(data,
+                            _mm_loadu_si128((const __m128i *)&sector[block * 16u]));
+    }
+
+    return (_mm_movemask_epi8(_mm_cmpeq_epi8(data, zero)) == 0xffff) &&
+           (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(
+                (const __m128i *)trailer), expected)) == 0xffff);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    uint8x16_t data = vdupq_n_u8(0);
+    uint8x16_t expected = vld1q_u8(default_trailer);
+
+    for(block = 0; block < blocks - 1u; block++)
+    {
+        data = vorrq_u8(data, vld1q_u8(&sector[block * 16u]));
+    }
+
+    return (vmaxvq_u8(data) == 0) &&
+           (vminvq_u8(vceqq_u8(vld1q_u8(trailer), expected)) == 0xff);
+#else
+    unsigned char data = 0;
+    unsigned i;
+
+    for(block = 0; block < blocks - 1u; block++)
+    {
+        for(i = 0; i < 16u; i++)
+        {
+            data |= sector[block * 16u + i];
+        }
+    }
+
+    return (data == 0) && (memcmp(trailer, default_trailer, 16u) == 0);
+#endif
+}
+
+/**************************************************************************//**
+ * Decodes the value block. The block is compared at once against the copy
+ * expected from its first value and address bytes, so the check takes no
+ * branch. Returns whether the block has the layout of a value block.
+ *****************************************************************************/
+bool mfd_decode_value(const uint8_t *block, struct mfd_value *value)
+{
+    bool valid;
+
+    value->value = (int32_t)((uint32_t)block[0] | ((uint32_t)block[1] << 8) |
+                             ((uint32_t)block[2] << 16) |
+                             ((uint32_t)block[3] << 24));
+    value->address = block[12];
+
+#if defined(__SSE2__)
+    {
+        __m128i data = _mm_loadu_si128((const __m128i *)block);
+        /* value value value addr, then the inversion of the copies */
+        __m128i words = _mm_and_si128(
+            _mm_shuffle_epi32(data, _MM_SHUFFLE(3, 0, 0, 0)),
+            _mm_set_epi32(0, -1, -1, -1));
+        __m128i address = _mm_and_si128(data, _mm_set_epi32(0xff, 0, 0, 0));
+        __m128i expected;
+
+        /* the address byte to all four bytes of the last word */
+        address = _mm_or_si128(address, _mm_slli_epi32(address, 8));
+        address = _mm_or_si128(address, _mm_slli_epi32(address, 16));
+        expected = _mm_xor_si128(_mm_or_si128(words, address),
+                                 _mm_set_epi32((int)0xff00ff00u, 0, -1, 0));
+
+        valid = _mm_movemask_epi8(_mm_cmpeq_epi8(data, expected)) == 0xffff;
+    }
+#else
+    {
+        uint8_t expected[16];
+        uint32_t w[4], e[4];
+        unsigned i;
+
+        for(i = 0; i < 4u; i++)
+        {
+            expected[i] = block[i];
+            expected[i + 4u] = (uint8_t)~block[i];
+            expected[i + 8u] = block[i];
+        }
+        expected[12] = block[12];
+        expected[13] = (uint8_t)~block[12];
+        expected[14] = block[12];
+        expected[15] = (uint8_t)~block[12];
+        memcpy(w, block, sizeof(w));
+        memcpy(e, expected, sizeof(e));
+        valid = ((w[0] ^ e[0]) | (w[1] ^ e[1]) | (w[2] ^ e[2]) |
+                 (w[3] ^ e[3])) == 0;
+    }
+#endif
+    value->valid = valid;
+
+    return valid;
+}
+
+/**************************************************************************//**
+ * Checks whether the access condition of a data block configures it as a
+ * value block, with increment and decrement allowed.
+ *****************************************************************************/
+bool mfd_is_value_condition(int condition)
+{
+    return (condition == 1) || (condition == 6);
+}
+
+/**************************************************************************//**
+ * Returns the reads and writes of a data block allowed by its access
+ * condition as a mask of MFD_READ_A to MFD_WRITE_B.
+ *****************************************************************************/
+unsigned mfd_data_access(unsigned condition)
+{
+    return data_access[condition & 0x07u];
+}
+
+/**************************************************************************//**
+ * Returns the access to the sector trailer allowed by its access condition
+ * as a mask of MFD_READ_A to MFD_WRITE_B: the read of key B and the writes of
+ * the keys or the access bits. Key A itself is never readable.
+ *****************************************************************************/
+unsigned mfd_trailer_access(unsigned condition)
+{
+    return trailer_access[condition & 0x07u];
+}
+
+/**************************************************************************//**
+ * Compares two dumps of the given number of blocks 16 bytes at a time. Bit x
+ * of changed[x / 64] is set for every block x which differs, the array must
+ * hold (blocks + 63) / 64 words. Returns the number of changed blocks.
+ *****************************************************************************/
+unsigned mfd_diff_blocks(const uint8_t *a, const uint8_t *b, unsigned blocks,
+                         uint64_t *changed)
+{
+    unsigned block;
+    unsigned count = 0;
+
+    for(block = 0; block < (blocks + 63u) / 64u; block++)
+    {
+        changed[block] = 0;
+    }
+
+    for(block = 0; block < blocks; block++)
+    {
+        const uint8_t *pa = &a[block * MFD_BLOCK_SIZE];
+        const uint8_t *pb = &b[block * MFD_BLOCK_SIZE];
+        unsigned differs;
+
+#if defined(__SSE2__)
+        differs = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                      _mm_loadu_si128((const __m128i *)pa),
+                      _mm_loadu_si128((const __m128i *)pb))) != 0xffff;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        differs = vminvq_u8(vceqq_u8(vld1q_u8(pa), vld1q_u8(pb))) != 0xff;
+#else
+        uint64_t wa[2], wb[2];
+
+        memcpy(wa, pa, sizeof(wa));
+        memcpy(wb, pb, sizeof(wb));
+        differs = ((wa[0] ^ wb[0]) | (wa[1] ^ wb[1])) != 0;
+#endif
+        changed[block / 64u] |= (uint64_t)differs << (block % 64u);
+        count += differs;
+    }
+
+    return count;
+}
+
+/**************************************************************************//**
+ * Returns the number of sectors of the card the dump of data_size bytes has
+ * been read from, or 0 if no card has this size.
+ *****************************************************************************/
+unsigned mfd_card_sectors(size_t data_size)
+{
+    switch(data_size)
+    {
+    case 320u:
+        return 5u;
+    case 1024u:
+        return 16u;
+    case 2048u:
+        return 32u;
+    case 4096u:
+        return 32u + 8u;
+    default:
+        return 0;
+    }
+}
+
+/**************************************************************************//**
+ * Returns the type of the card answering the SAK, or MFD_CARD_UNKNOWN. The
+ * emulations by SmartMX and the Infineon cards answer their own values.
+ *****************************************************************************/
+static unsigned card_by_sak(uint8_t sak)
+{
+    switch(sak)
+    {
+    case 0x09u:
+        return MFD_CARD_MINI;
+    case 0x08u:
+    case 0x28u:
+    case 0x88u:
+        return MFD_CARD_1K;
+    case 0x19u:
+        return MFD_CARD_2K;
+    case 0x18u:
+    case 0x38u:
+    case 0x98u:
+    case 0xb8u:
+        return MFD_CARD_4K;
+    default:
+        return MFD_CARD_UNKNOWN;
+    }
+}
+
+/**************************************************************************//**
+ * Checks whether the bytes are all 00 or all FF, the padding written by the
+ * tools saving every dump in the size of the biggest card.
+ *****************************************************************************/
+static bool is_padding(const uint8_t *data, size_t len)
+{
+    uint8_t fill = data[0];
+    unsigned differs = 0;
+    size_t i;
+
+    if((fill != 0x00u) && (fill != 0xffu))
+    {
+        return false;
+    }
+    for(i = 1; i < len; i++)
+    {
+        differs |= data[i] ^ fill;
+    }
+
+    return differs == 0;
+}
+
+/**************************************************************************//**
+ * Returns the size of the memory of the card type, or 0 if it is not known.
+ *****************************************************************************/
+unsigned mfd_card_size(unsigned type)
+{
+    switch(type)
+    {
+    case MFD_CARD_MINI:
+        return 320u;
+    case MFD_CARD_1K:
+        return 1024u;
+    case MFD_CARD_2K:
+        return 2048u;
+    case MFD_CARD_4K:
+        return 4096u;
+    default:
+        return 0;
+    }
+}
+
+/**************************************************************************//**
+ * Returns the name of the card type as used by NXP: Mini, 1K, 2K or 4K.
+ *****************************************************************************/
+const char *mfd_card_name(unsigned type)
+{
+    switch(type)
+    {
+    case MFD_CARD_MINI:
+        return "Mini";
+    case MFD_CARD_1K:
+        return "1K";
+    case MFD_CARD_2K:
+        return "2K";
+    case MFD_CARD_4K:
+        return "4K";
+    default:
+        return "unknown";
+    }
+}
+
+/**************************************************************************//**
+ * Tells the card from its manufacturer block. A 4 byte UID is followed by
+ * BCC, SAK and ATQA; a 7 byte UID directly by SAK and ATQA, whose UID size
+ * bits say double size. The 4 byte layout is taken if its BCC matches, the
+ * type is then given by SAK.
+ *****************************************************************************/
+void mfd_detect_card(const uint8_t *data, size_t data_size,
+                     struct mfd_card *card)
+{
+    memset(card, 0, sizeof(*card));
+    card->uid_len = 4u;
+    card->sak_offset = 5u;
+    if(data_size < MFD_BLOCK_SIZE)
+    {
+        return;
+    }
+
+    if(((data[0] ^ data[1] ^ data[2] ^ data[3]) != data[4]) &&
+       ((data[8] & 0xc0u) == 0x40u) &&
+       (card_by_sak(data[7]) != MFD_CARD_UNKNOWN))
+    {
+        card->uid_len = 7u;
+        card->sak_offset = 7u;
+        card->type = (uint8_t)card_by_sak(data[7]);
+    }
+    else if((data[0] ^ data[1] ^ data[2] ^ data[3]) == data[4])
+    {
+        card->type = (uint8_t)card_by_sak(data[5]);
+    }
+    card->sak = data[card->sak_offset];
+    card->atqa = (uint16_t)(data[card->sak_offset + 1u] |
+                            (data[card->sak_offset + 2u] << 8));
+}
+
+/**************************************************************************//**
+ * Decodes the geometry of the dump of data_size bytes and the trailers of the
+ * sectors selected by bit x of sectors for sector x. The access conditions
+ * of the other sectors are left invalid and not counted in access_errors.
+ * The geometry is the one of the card told by block 0 when the dump is
+ * longer just by padding, otherwise the size of the dump decides. The data
+ * are referenced by info, not copied, so they must be kept while info is
+ * used. Returns MFD_ERR_SIZE if the size of the dump does not match any card.
+ *****************************************************************************/
+int mfd_decode_selected(const uint8_t *data, size_t data_size,
+                        uint64_t sectors, struct mfd_dump *info)
+{
+    unsigned sector;
+    unsigned card_size;
+
+    if(mfd_card_sectors(data_size) == 0)
+    {
+        return MFD_ERR_SIZE;
+    }
+
+    mfd_detect_card(data, data_size, &info->card);
+    info->data = data;
+    info->dump_size = (unsigned)data_size;
+    info->data_size = (unsigned)data_size;
+    card_size = mfd_card_size(info->card.type);
+    if((card_size > 0) && (card_size < data_size) &&
+       is_padding(&data[card_size], data_size - card_size))
+    {
+        info->data_size = card_size;
+    }
+    info->sectors = mfd_card_sectors(info->data_size);
+    info->access_errors = 0;
+
+    for(sector = 0; sector < info->sectors; sector++)
+    {
+        struct mfd_sector *si = &info->sector[sector];
+
+        unsigned blocks;
+
+        si->start = (uint16_t)mfd_sector_layout(sector, &blocks);
+        si->blocks = (uint8_t)blocks;
+        si->trailer = (uint16_t)(si->start + (blocks - 1u) * MFD_BLOCK_SIZE);
+        if(!(sectors & ((uint64_t)1 << sector)))
+        {
+            memset(&si->ac, 0, sizeof(si->ac));
+            continue;
+        }
+        /* the trailer is decoded once for all the blocks of the sector */
+        mfd_decode_access_bits(&data[si->trailer + 6u], &si->ac);
+        if(si->ac.valid != 0x0fu)
+        {
+            info->access_errors++;
+        }
+    }
+
+    return MFD_OK;
+}
+
+/**************************************************************************//**
+ * Decodes the geometry and all the sector trailers of the dump of data_size
+ * bytes. The data are referenced by info, not copied, so they must be kept
+ * while info is used. Returns MFD_ERR_SIZE if the size of the dump does not
+ * match any card.
+ *****************************************************************************/
+int mfd_decode(const uint8_t *data, size_t data_size, struct mfd_dump *info)
+{
+    return mfd_decode_selected(data, data_size, MFD_ALL_SECTORS, info);
+}
+
+/**************************************************************************//**
+ * Returns the 6 byte key as a 48 bit number, the 1st byte is the most
+ * significant one.
+ *****************************************************************************/
+uint64_t mfd_key48(const uint8_t *key)
+{
+    return ((uint64_t)key[0] << 40) | ((uint64_t)key[1] << 32) |
+           ((uint64_t)key[2] << 24) | ((uint64_t)key[3] << 16) |
+           ((uint64_t)key[4] << 8) | (uint64_t)key[5];
+}
+
+/**************************************************************************//**
+ * Decodes n dumps and appends their trailers to the arrays of soa. Dumps not
+ * fitting to the capacity are skipped. Dumps of a wrong size are stored with
+ * no sectors, so the index in soa still matches the index of the dump.
+ * Returns the number of dumps stored.
+ *****************************************************************************/
+size_t mfd_decode_batch(const uint8_t *const *dumps, const size_t *sizes,
+                        size_t n, struct mfd_soa *soa)
+{
+    size_t i;
+
+    for(i = 0; (i < n) && (soa->count < soa->capacity); i++)
+    {
+        size_t d = soa->count++;
+        struct mfd_dump dump;
+        unsigned sector;
+
+        if(mfd_decode(dumps[i], sizes[i], &dump) != MFD_OK)
+        {
+            dump.sectors = 0;
+        }
+        soa->sectors[d] = (uint8_t)dump.sectors;
+
+        for(sector = 0; sector < dump.sectors; sector++)
+        {
+            const struct mfd_sector *si = &dump.sector[sector];
+
+            soa->keysA[d][sector] = mfd_key48(&dumps[i][si->trailer]);
+            soa->keysB[d][sector] = mfd_key48(&dumps[i][si->trailer + 10u]);
+            memcpy(soa->conditions[d][sector], si->ac.cond, 4);
+            soa->valid[d][sector] = si->ac.valid;
+        }
+        for(; sector < MFD_MAX_SECTORS; sector++)
+        {
+            soa->keysA[d][sector] = MFD_KEY_NONE;
+            soa->keysB[d][sector] = MFD_KEY_NONE;
+            memset(soa->conditions[d][sector], 0, 4);
+            soa->valid[d][sector] = 0x0fu;
+        }
+    }
+
+    return i;
+}
+
+#if defined(MFD_DISPATCH_AVX2)
+/**************************************************************************//**
+ * Matches the key against all the sectors of all the dumps, four keys at a
+ * time. The selections use_a and use_b are all ones or all zeros.
+ *****************************************************************************/
+__attribute__((target("avx2")))
+static void match_keys_avx2(const struct mfd_soa *soa, uint64_t key,
+                            uint64_t use_a, uint64_t use_b, uint64_t *masks)
+{
+    __m256i k = _mm256_set1_epi64x((long long)key);
+    __m256i sel_a = _mm256_set1_epi64x((long long)use_a);
+    __m256i sel_b = _mm256_set1_epi64x((long long)use_b);
+    size_t d;
+
+    for(d = 0; d < soa->count; d++)
+    {
+        uint64_t mask = 0;
+        unsigned sector;
+
+        for(sector = 0; sector < MFD_MAX_SECTORS; sector += 4u)
+        {
+            __m256i a = _mm256_cmpeq_epi64(_mm256_loadu_si256(
+                            (const __m256i *)&soa->keysA[d][sector]), k);
+            __m256i b = _mm256_cmpeq_epi64(_mm256_loadu_si256(
+                            (const __m256i *)&soa->keysB[d][sector]), k);
+            __m256i hit = _mm256_or_si256(_mm256_and_si256(a, sel_a),
+                                          _mm256_and_si256(b, sel_b));
+
+            mask |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(hit))
+                    << sector;
+        }
+        masks[d] = mask;
+    }
+}
+#endif
+
+/**************************************************************************//**
+ * Matches the key against the sectors of one dump. The selections use_a and
+ * use_b are all ones or all zeros. Returns bit s set for every sector s
+ * using the key.
+ *****************************************************************************/
+static uint64_t match_key(const uint64_t *keysA, const uint64_t *keysB,
+                          uint64_t key, uint64_t use_a, uint64_t use_b)
+{
+    uint64_t mask = 0;
+    unsigned sector;
+
+#if defined(__SSE2__)
+    __m128i k = _mm_set1_epi64x((long long)key);
+    __m128i sel_a = _mm_set1_epi64x((long long)use_a);
+    __m128i sel_b = _mm_set1_epi64x((long long)use_b);
+
+    for(sector = 0; sector < MFD_MAX_SECTORS; sector += 2u)
+    {
+        __m128i a = _mm_cmpeq_epi32(
+                        _mm_loadu_si128((const __m128i *)&keysA[sector]), k);
+        __m128i b = _mm_cmpeq_epi32(
+                        _mm_loadu_si128((const __m128i *)&keysB[sector]), k);
+        __m128i hit;
+
+        /* SSE2 compares 32 bit words, both halves of a key must match */
+        a = _mm_and_si128(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+        b = _mm_and_si128(b, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1)));
+        hit = _mm_or_si128(_mm_and_si128(a, sel_a), _mm_and_si128(b, sel_b));
+        mask |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(hit)) << sector;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    uint64x2_t k = vdupq_n_u64(key);
+    uint64x2_t sel_a = vdupq_n_u64(use_a);
+    uint64x2_t sel_b = vdupq_n_u64(use_b);
+
+    for(sector = 0; sector < MFD_MAX_SECTORS; sector += 2u)
+    {
+        uint64x2_t hit = vorrq_u64(
+            vandq_u64(vceqq_u64(vld1q_u64(&keysA[sector]), k), sel_a),
+            vandq_u64(vceqq_u64(vld1q_u64(&keysB[sector]), k), sel_b));
+
+        mask |= ((vgetq_lane_u64(hit, 0) & 1u) |
+                 ((vgetq_lane_u64(hit, 1) & 1u) << 1)) << sector;
+    }
+#else
+    for(sector = 0; sector < MFD_MAX_SECTORS; sector++)
+    {
+        uint64_t hit = ((uint64_t)(keysA[sector] == key) & use_a) |
+                       ((uint64_t)(keysB[sector] == key) & use_b);
+        mask |= hit << sector;
+    }
+#endif
+
+    return mask;
+}
+
+/**************************************************************************//**
+ * Finds the sectors using the key as key A and/or key B, as selected by
+ * MFD_KEY_A and MFD_KEY_B in which. Bit s of masks[d] is set if sector s of
+ * dump d uses the key; masks must hold soa->count items.
+ *****************************************************************************/
+void mfd_soa_match_key(const struct mfd_soa *soa, unsigned which,
+                       uint64_t key, uint64_t *masks)
+{
+    uint64_t use_a = (which & MFD_KEY_A) ? UINT64_MAX : 0;
+    uint64_t use_b = (which & MFD_KEY_B) ? UINT64_MAX : 0;
+    size_t d;
+
+#if defined(MFD_DISPATCH_AVX2)
+    if(mfd_simd() == MFD_SIMD_AVX2)
+    {
+        match_keys_avx2(soa, key, use_a, use_b, masks);
+        return;
+    }
+#endif
+
+    for(d = 0; d < soa->count; d++)
+    {
+        masks[d] = match_key(soa->keysA[d], soa->keysB[d], key, use_a, use_b);
+    }
+}
+
+/**************************************************************************//**
+ * Finds the sectors with invalid access bits. Bit s of masks[d] is set if
+ * any of the inverted access bits of sector s of dump d does not match;
+ * masks must hold soa->count items.
+ *****************************************************************************/
+void mfd_soa_invalid(const struct mfd_soa *soa, uint64_t *masks)
+{
+    size_t d;
+
+    for(d = 0; d < soa->count; d++)
+    {
+        uint64_t mask = 0;
+        unsigned sector;
+
+        for(sector = 0; sector < MFD_MAX_SECTORS; sector++)
+        {
+            mask |= (uint64_t)(soa->valid[d][sector] != 0x0fu) << sector;
+        }
+        masks[d] = mask;
+    }
+}
+
+/**************************************************************************//**
+ * Reads a little endian 64 bit word.
+ *****************************************************************************/
+static uint64_t read_le64(const uint8_t *p)
+{
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) |
+           ((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) |
+           ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) |
+           ((uint64_t)p[7] << 56);
+}
+
+/**************************************************************************//**
+ * Rotates the 64 bit word left.
+ *****************************************************************************/
+static uint64_t rotl64(uint64_t x, unsigned r)
+{
+    return (x << r) | (x >> (64u - r));
+}
+
+/**************************************************************************//**
+ * Mixes one input word into the XXH64 accumulator.
+ *****************************************************************************/
+static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+/**************************************************************************//**
+ * Merges one XXH64 lane into the hash.
+ *****************************************************************************/
+static uint64_t xxh64_merge(uint64_t acc, uint64_t value)
+{
+    acc ^= xxh64_round(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/**************************************************************************//**
+ * XXH64 hash of the data with seed 0. Used as a digest of dump contents.
+ *****************************************************************************/
+uint64_t mfd_xxh64(const uint8_t *data, size_t len)
+{
+    const uint8_t *end = &data[len];
+    uint64_t h;
+
+    if(len >= 32u)
+    {
+        uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = XXH_PRIME64_2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - XXH_PRIME64_1;
+
+        do
+        {
+            v1 = xxh64_round(v1, read_le64(&data[0]));
+            v2 = xxh64_round(v2, read_le64(&data[8]));
+            v3 = xxh64_round(v3, read_le64(&data[16]));
+            v4 = xxh64_round(v4, read_le64(&data[24]));
+            data += 32;
+        }
+        while(data + 32 <= end);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    }
+    else
+    {
+        h = XXH_PRIME64_5;
+    }
+
+    h += (uint64_t)len;
+
+    while(data + 8 <= end)
+    {
+        h ^= xxh64_round(0, read_le64(data));
+        h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        data += 8;
+    }
+    if(data + 4 <= end)
+    {
+        uint64_t k = (uint64_t)data[0] | ((uint64_t)data[1] << 8) |
+                     ((uint64_t)data[2] << 16) | ((uint64_t)data[3] << 24);
+        h ^= k * XXH_PRIME64_1;
+        h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        data += 4;
+    }
+    while(data < end)
+    {
+        h ^= (*data++) * XXH_PRIME64_5;
+        h = rotl64(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/**************************************************************************//**
+ * Returns the instruction set of the kernels used on this CPU, one of
+ * MFD_SIMD_SCALAR to MFD_SIMD_NEON: AVX2 when the CPU has it and its kernels
+ * are built in, otherwise the one the library has been compiled for. The
+ * check costs a load, so it is done at every call.
+ *****************************************************************************/
+unsigned mfd_simd(void)
+{
+#if defined(MFD_DISPATCH_AVX2)
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return MFD_SIMD_AVX2;
+    }
+#endif
+#if defined(__SSE2__)
+    return MFD_SIMD_SSE2;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    return MFD_SIMD_NEON;
+#else
+    return MFD_SIMD_SCALAR;
+#endif
+}
+
+/**************************************************************************//**
+ * Returns the name of the instruction set returned by mfd_simd().
+ *****************************************************************************/
+const char *mfd_simd_name(unsigned simd)
+{
+    static const char * const names[] = { "scalar", "sse2", "avx2", "neon" };
+
+    return (simd < sizeof(names) / sizeof(names[0])) ? names[simd] : "scalar";
+}
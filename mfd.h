@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * libmfdread: decoder of Mifare Classic dumps
+ * The decoder works on a buffer owned by the caller and fills a structure
+ * owned by the caller. It does no heap allocation and no I/O, so it can be
+ * embedded in other programs and called from more threads at once.
+ *****************************************************************************/
+#ifndef MFD_H
+#define MFD_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* biggest dump that can be decoded */
+#define MFD_MAX_DUMP_SIZE   4096u
+/* number of sectors of the biggest card */
+#define MFD_MAX_SECTORS     40u
+/* size of one block */
+#define MFD_BLOCK_SIZE      16u
+/* selection of all the sectors for mfd_decode_selected() */
+#define MFD_ALL_SECTORS     UINT64_MAX
+
+/* blocks of the biggest card */
+#define MFD_MAX_BLOCKS      (MFD_MAX_DUMP_SIZE / MFD_BLOCK_SIZE)
+
+/* expand M(i) for 4 to 4096 consecutive values starting at i, used to build
+   lookup tables at compile time */
+#define MFD_REPEAT4(M, i)   M(i) M((i) + 1) M((i) + 2) M((i) + 3)
+#define MFD_REPEAT16(M, i)  MFD_REPEAT4(M, i) MFD_REPEAT4(M, (i) + 4) \
+                            MFD_REPEAT4(M, (i) + 8) MFD_REPEAT4(M, (i) + 12)
+#define MFD_REPEAT64(M, i)  MFD_REPEAT16(M, i) MFD_REPEAT16(M, (i) + 16) \
+                            MFD_REPEAT16(M, (i) + 32) MFD_REPEAT16(M, (i) + 48)
+#define MFD_REPEAT256(M, i) MFD_REPEAT64(M, i) MFD_REPEAT64(M, (i) + 64) \
+                            MFD_REPEAT64(M, (i) + 128) MFD_REPEAT64(M, (i) + 192)
+#define MFD_REPEAT1024(M, i) MFD_REPEAT256(M, i) MFD_REPEAT256(M, (i) + 256) \
+                            MFD_REPEAT256(M, (i) + 512) MFD_REPEAT256(M, (i) + 768)
+#define MFD_REPEAT4096(M, i) MFD_REPEAT1024(M, i) MFD_REPEAT1024(M, (i) + 1024) \
+                            MFD_REPEAT1024(M, (i) + 2048) MFD_REPEAT1024(M, (i) + 3072)
+
+/* key of a sector not present on the card in struct mfd_soa */
+#define MFD_KEY_NONE        UINT64_MAX
+
+/* selection of keys for mfd_soa_match_key() */
+#define MFD_KEY_A           0x01u
+#define MFD_KEY_B           0x02u
+
+/* access to a data block or a trailer granted by the keys, see
+   mfd_data_access() and mfd_trailer_access() */
+#define MFD_READ_A          0x01u
+#define MFD_READ_B          0x02u
+#define MFD_WRITE_A         0x04u
+#define MFD_WRITE_B         0x08u
+
+/* card types told by mfd_detect_card() from the manufacturer block */
+#define MFD_CARD_UNKNOWN    0
+#define MFD_CARD_MINI       1
+#define MFD_CARD_1K         2
+#define MFD_CARD_2K         3
+#define MFD_CARD_4K         4
+
+/* instruction sets of the kernels, see mfd_simd() */
+#define MFD_SIMD_SCALAR     0
+#define MFD_SIMD_SSE2       1
+#define MFD_SIMD_AVX2       2
+#define MFD_SIMD_NEON       3
+
+/* AVX2 kernels are built next to the SSE2 ones and chosen at run time by
+   the CPU, unless MFD_NO_DISPATCH is defined */
+#if defined(__SSE2__) && defined(__GNUC__) && !defined(MFD_NO_DISPATCH)
+#   define MFD_DISPATCH_AVX2
+#endif
+
+/* return values of mfd_decode() */
+#define MFD_OK              0
+#define MFD_ERR_SIZE        (-1)
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* access conditions of the blocks decoded from a sector trailer */
+struct mfd_access
+{
+    uint8_t cond[4];            /* C1x C2x C3x of block group x */
+    uint8_t valid;              /* bit x is set if cond[x] is valid */
+};
+
+/* content of a value block: value, ~value, value, addr, ~addr, addr, ~addr */
+struct mfd_value
+{
+    int32_t value;              /* little endian in the block */
+    uint8_t address;
+    bool valid;                 /* all the inverted copies match */
+};
+
+/* decoded layout and access conditions of one sector */
+struct mfd_sector
+{
+    uint16_t start;             /* offset of the 1st block in the dump */
+    uint16_t trailer;           /* offset of the sector trailer */
+    uint8_t blocks;
+    struct mfd_access ac;
+};
+
+/* card identified by the manufacturer block, block 0 of the dump */
+struct mfd_card
+{
+    uint8_t type;               /* MFD_CARD_UNKNOWN if SAK is not known */
+    uint8_t uid_len;            /* 4 or 7 bytes */
+    uint8_t sak_offset;         /* offset of SAK in block 0, ATQA follows */
+    uint8_t sak;
+    uint16_t atqa;              /* stored low byte first in block 0 */
+};
+
+/* decoded dump, the data are not copied */
+struct mfd_dump
+{
+    const uint8_t *data;
+    unsigned data_size;         /* bytes of the card decoded */
+    unsigned dump_size;         /* bytes given, more for padded dumps */
+    unsigned sectors;
+    struct mfd_card card;
+    unsigned access_errors;     /* sectors with invalid access bits */
+    struct mfd_sector sector[MFD_MAX_SECTORS];
+};
+
+/* Trailers of many dumps in a structure of arrays, so a question asked for
+   every card is a linear scan over one array. The arrays are owned by the
+   caller and hold capacity dumps each; the keys are 48 bit numbers in the
+   byte order shown in the dump. Sectors beyond the size of a card have the
+   keys MFD_KEY_NONE and all access bits valid. */
+struct mfd_soa
+{
+    size_t capacity;
+    size_t count;               /* dumps stored so far */
+    uint64_t (*keysA)[MFD_MAX_SECTORS];
+    uint64_t (*keysB)[MFD_MAX_SECTORS];
+    uint8_t (*conditions)[MFD_MAX_SECTORS][4];
+    uint8_t (*valid)[MFD_MAX_SECTORS];
+    uint8_t *sectors;           /* 0 for dumps of a wrong size */
+};
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+unsigned mfd_card_sectors(size_t data_size);
+unsigned mfd_card_size(unsigned type);
+const char *mfd_card_name(unsigned type);
+void mfd_detect_card(const uint8_t *data, size_t data_size,
+                     struct mfd_card *card);
+int mfd_decode(const uint8_t *data, size_t data_size, struct mfd_dump *dump);
+int mfd_decode_selected(const uint8_t *data, size_t data_size,
+                        uint64_t sectors, struct mfd_dump *dump);
+
+void mfd_decode_access_bits(const uint8_t *access_bits, struct mfd_access *ac);
+unsigned mfd_access_group(unsigned sector, unsigned block);
+int mfd_block_condition(const struct mfd_access *ac, unsigned sector,
+                        unsigned block);
+int mfd_get_access_condition(unsigned sector, unsigned block,
+                             const uint8_t *access_bits);
+
+unsigned mfd_sector_layout(unsigned sector, unsigned *blocks);
+bool mfd_sector_is_default(const uint8_t *sector, unsigned blocks);
+bool mfd_decode_value(const uint8_t *block, struct mfd_value *value);
+bool mfd_is_value_condition(int condition);
+unsigned mfd_data_access(unsigned condition);
+unsigned mfd_trailer_access(unsigned condition);
+unsigned mfd_diff_blocks(const uint8_t *a, const uint8_t *b, unsigned blocks,
+                         uint64_t *changed);
+
+uint64_t mfd_key48(const uint8_t *key);
+size_t mfd_decode_batch(const uint8_t *const *dumps, const size_t *sizes,
+                        size_t n, struct mfd_soa *soa);
+void mfd_soa_match_key(const struct mfd_soa *soa, unsigned which,
+                       uint64_t key, uint64_t *masks);
+void mfd_soa_invalid(const struct mfd_soa *soa, uint64_t *masks);
+
+uint64_t mfd_xxh64(const uint8_t *data, size_t len);
+
+unsigned mfd_simd(void);
+const char *mfd_simd_name(unsigned simd);
+
+#endif /* MFD_H */
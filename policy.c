@@ -0,0 +1,396 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Access policies checked on the decoded trailers
+ *
+ * A policy file holds one rule per line, the text after # is a comment:
+ *
+ *     deny trailer 001 sectors 1-39    trailer condition C1 C2 C3
+ *     deny data write A sectors 1-15   data blocks writable by key A
+ *     deny data 000                    data block condition C1 C2 C3
+ *     deny invalid                     invalid access bits
+ *
+ * Without "sectors" a rule applies to all the sectors.
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "policy.h"
+#include "ranges.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+#define POLICY_INITIAL      16u
+/* longest rule and most words of a rule */
+#define POLICY_LINE_MAX     256u
+#define POLICY_WORDS        6u
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Splits the line to words separated by blanks, cutting off the comment.
+ * Returns the number of words, or POLICY_WORDS + 1 if there are more.
+ *****************************************************************************/
+static unsigned split_words(char *text, char **words)
+{
+    unsigned n = 0;
+
+    for(;;)
+    {
+        while((*text == ' ') || (*text == '\t'))
+        {
+            text++;
+        }
+        if((*text == '\0') || (*text == '\n') || (*text == '\r') ||
+           (*text == '#'))
+        {
+            return n;
+        }
+        if(n == POLICY_WORDS)
+        {
+            return n + 1u;
+        }
+        words[n++] = text;
+        while((*text != '\0') && (*text != ' ') && (*text != '\t') &&
+              (*text != '\n') && (*text != '\r') && (*text != '#'))
+        {
+            text++;
+        }
+        if((*text == '\0') || (*text == '#'))
+        {
+            *text = '\0';
+            return n;
+        }
+        *text++ = '\0';
+    }
+}
+
+/**************************************************************************//**
+ * Parses the access condition given as the three bits C1 C2 C3. Returns -1
+ * for anything else.
+ *****************************************************************************/
+static int parse_condition(const char *text)
+{
+    unsigned i;
+    int condition = 0;
+
+    for(i = 0; i < 3u; i++)
+    {
+        if((text[i] != '0') && (text[i] != '1'))
+        {
+            return -1;
+        }
+        condition = (condition << 1) | (text[i] - '0');
+    }
+
+    return (text[3] == '\0') ? condition : -1;
+}
+
+/**************************************************************************//**
+ * Returns the mask of the data block conditions allowing the access, one of
+ * MFD_READ_A to MFD_WRITE_B.
+ *****************************************************************************/
+static uint8_t conditions_allowing(unsigned access)
+{
+    uint8_t mask = 0;
+    unsigned condition;
+
+    for(condition = 0; condition < 8u; condition++)
+    {
+        if(mfd_data_access(condition) & access)
+        {
+            mask |= (uint8_t)(1u << condition);
+        }
+    }
+
+    return mask;
+}
+
+/**************************************************************************//**
+ * Compiles the words of one rule. Returns -1 for a wrong rule.
+ *****************************************************************************/
+static int compile_rule(char **words, unsigned n, struct policy_rule *rule)
+{
+    unsigned i = 1;
+    int condition;
+
+    rule->sectors = MFD_ALL_SECTORS;
+    rule->trailer = 0;
+    rule->data = 0;
+    rule->invalid = false;
+
+    if((n < 2u) || (strcmp(words[0], "deny") != 0))
+    {
+        return -1;
+    }
+
+    if(strcmp(words[i], "invalid") == 0)
+    {
+        rule->invalid = true;
+        i++;
+    }
+    else if((i + 1u < n) && (strcmp(words[i], "trailer") == 0) &&
+            ((condition = parse_condition(words[i + 1u])) >= 0))
+    {
+        rule->trailer = (uint8_t)(1u << condition);
+        i += 2u;
+    }
+    else if((i + 1u < n) && (strcmp(words[i], "data") == 0) &&
+            ((condition = parse_condition(words[i + 1u])) >= 0))
+    {
+        rule->data = (uint8_t)(1u << condition);
+        i += 2u;
+    }
+    else if((i + 2u < n) && (strcmp(words[i], "data") == 0))
+    {
+        bool read = (strcmp(words[i + 1u], "read") == 0);
+        bool write = (strcmp(words[i + 1u], "write") == 0);
+        bool key_a = (strcmp(words[i + 2u], "A") == 0);
+        bool key_b = (strcmp(words[i + 2u], "B") == 0);
+
+        if(!(read || write) || !(key_a || key_b))
+        {
+            return -1;
+        }
+        rule->data = conditions_allowing(
+            read ? (key_a ? MFD_READ_A : MFD_READ_B)
+                 : (key_a ? MFD_WRITE_A : MFD_WRITE_B));
+        i += 3u;
+    }
+    else
+    {
+        return -1;
+    }
+
+    if((i + 2u == n) && (strcmp(words[i], "sectors") == 0))
+    {
+        return parse_ranges(words[i + 1u], MFD_MAX_SECTORS, &rule->sectors);
+    }
+
+    return (i == n) ? 0 : -1;
+}
+
+/**************************************************************************//**
+ * Copies the rule text without the comment and the trailing blanks.
+ *****************************************************************************/
+static char *copy_rule(const char *text)
+{
+    size_t len;
+    char *copy;
+
+    while((*text == ' ') || (*text == '\t'))
+    {
+        text++;
+    }
+    len = strcspn(text, "#\r\n");
+    while((len > 0) && ((text[len - 1u] == ' ') || (text[len - 1u] == '\t')))
+    {
+        len--;
+    }
+
+    copy = malloc(len + 1u);
+    if(copy != NULL)
+    {
+        memcpy(copy, text, len);
+        copy[len] = '\0';
+    }
+
+    return copy;
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Loads and compiles the rules of the policy file, the comments may be of any
+ * length. Returns -1 and sets errno on failure; a wrong rule gives EINVAL and
+ * its line number in line.
+ *****************************************************************************/
+int policy_load(struct policy *policy, const char *path, unsigned long *line)
+{
+    FILE *fp;
+    char text[POLICY_LINE_MAX];
+    size_t capacity = 0;
+
+    policy->rules = NULL;
+    policy->count = 0;
+    *line = 0;
+
+    fp = fopen(path, "r");
+    if(fp == NULL)
+    {
+        return -1;
+    }
+
+    while(fgets(text, sizeof(text), fp) != NULL)
+    {
+        char words_text[POLICY_LINE_MAX];
+        char *words[POLICY_WORDS];
+        struct policy_rule *rule;
+        unsigned n;
+
+        (*line)++;
+        /* the rest of a line longer than the buffer may only be a comment,
+           it is skipped without being read as the next line */
+        if((strchr(text, '\n') == NULL) && !feof(fp))
+        {
+            int c;
+
+            if(strchr(text, '#') == NULL)
+            {
+                fclose(fp);
+                policy_free(policy);
+                errno = EINVAL;
+                return -1;
+            }
+            do
+            {
+                c = fgetc(fp);
+            } while((c != EOF) && (c != '\n'));
+        }
+        memcpy(words_text, text, sizeof(text));
+        n = split_words(words_text, words);
+        if(n == 0)
+        {
+            continue;
+        }
+
+        if(policy->count == capacity)
+        {
+            size_t bigger = capacity ? 2u * capacity : POLICY_INITIAL;
+            struct policy_rule *rules = realloc(policy->rules,
+                                                bigger * sizeof(*rules));
+
+            if(rules == NULL)
+            {
+                fclose(fp);
+                policy_free(policy);
+                errno = ENOMEM;
+                return -1;
+            }
+            policy->rules = rules;
+            capacity = bigger;
+        }
+
+        rule = &policy->rules[policy->count];
+        if((n > POLICY_WORDS) || (compile_rule(words, n, rule) != 0))
+        {
+            fclose(fp);
+            policy_free(policy);
+            errno = EINVAL;
+            return -1;
+        }
+        rule->line = (unsigned)*line;
+        rule->text = copy_rule(text);
+        if(rule->text == NULL)
+        {
+            fclose(fp);
+            policy_free(policy);
+            errno = ENOMEM;
+            return -1;
+        }
+        policy->count++;
+    }
+
+    if(ferror(fp))
+    {
+        fclose(fp);
+        policy_free(policy);
+        return -1;
+    }
+    fclose(fp);
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Releases the rules of the policy.
+ *****************************************************************************/
+void policy_free(struct policy *policy)
+{
+    size_t i;
+
+    for(i = 0; i < policy->count; i++)
+    {
+        free(policy->rules[i].text);
+    }
+    free(policy->rules);
+    policy->rules = NULL;
+    policy->count = 0;
+}
+
+/**************************************************************************//**
+ * Checks the selected sectors of the dump against all the rules and writes a
+ * line for every violation. The conditions of a sector are turned to masks
+ * once: the trailer condition, the conditions of the data block groups and
+ * the invalid ones, then every rule is tested by a few bit operations. The
+ * number of violations is returned in violations. Returns -1 on out of
+ * memory.
+ *****************************************************************************/
+int policy_check(const struct policy *policy, const char *name,
+                 const struct mfd_dump *info, uint64_t sectors,
+                 struct output *out, unsigned *violations)
+{
+    unsigned sector;
+
+    *violations = 0;
+    for(sector = 0; sector < info->sectors; sector++)
+    {
+        const struct mfd_access *ac = &info->sector[sector].ac;
+        uint64_t bit = (uint64_t)1u << sector;
+        /* groups with invalid bits match no condition */
+        unsigned trailer = (ac->valid & 0x08u) ? 1u << ac->cond[3] : 0;
+        unsigned data = ((ac->valid & 0x01u) ? 1u << ac->cond[0] : 0) |
+                        ((ac->valid & 0x02u) ? 1u << ac->cond[1] : 0) |
+                        ((ac->valid & 0x04u) ? 1u << ac->cond[2] : 0);
+        bool invalid = (ac->valid != 0x0fu);
+        size_t i;
+
+        if(!(sectors & bit))
+        {
+            continue;
+        }
+
+        for(i = 0; i < policy->count; i++)
+        {
+            const struct policy_rule *rule = &policy->rules[i];
+
+            if(!(rule->sectors & bit) ||
+               !((rule->trailer & trailer) | (rule->data & data) |
+                 (rule->invalid & invalid)))
+            {
+                continue;
+            }
+
+            (*violations)++;
+            if(out_printf(out, "%s: sector %u: %s (line %u)\n", name, sector,
+                          rule->text, rule->line) < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
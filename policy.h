@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Access policies checked on the decoded trailers. The rules of a policy
+ * file are compiled to masks of the denied access conditions, so a sector
+ * is checked by a few bit operations per rule.
+ *****************************************************************************/
+#ifndef POLICY_H
+#define POLICY_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "format.h"
+#include "mfd.h"
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* one compiled rule, it is violated by a sector of the sectors mask with a
+   denied condition of the trailer or of a data block group, or with invalid
+   access bits when invalid is set */
+struct policy_rule
+{
+    uint64_t sectors;           /* bit x for sector x */
+    uint8_t trailer;            /* bit c denies the trailer condition c */
+    uint8_t data;               /* bit c denies the data block condition c */
+    bool invalid;
+    unsigned line;
+    char *text;                 /* the rule as written, for the reports */
+};
+
+struct policy
+{
+    struct policy_rule *rules;
+    size_t count;
+};
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int policy_load(struct policy *policy, const char *path, unsigned long *line);
+void policy_free(struct policy *policy);
+int policy_check(const struct policy *policy, const char *name,
+                 const struct mfd_dump *info, uint64_t sectors,
+                 struct output *out, unsigned *violations);
+
+#endif /* POLICY_H */
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Lists of numbers and ranges selecting the sectors and blocks
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stdlib.h>
+#include "ranges.h"
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Parses a list of numbers and ranges like 1-3,10 to a mask with bit x set
+ * for number x. The numbers must be lower than max. Returns -1 for a wrong
+ * list.
+ *****************************************************************************/
+int parse_ranges(const char *text, unsigned max, uint64_t *mask)
+{
+    *mask = 0;
+    for(;;)
+    {
+        char *end;
+        unsigned long first, last;
+
+        if((*text < '0') || (*text > '9'))
+        {
+            return -1;
+        }
+        first = strtoul(text, &end, 10);
+        last = first;
+        if(*end == '-')
+        {
+            text = end + 1;
+            if((*text < '0') || (*text > '9'))
+            {
+                return -1;
+            }
+            last = strtoul(text, &end, 10);
+        }
+        if((first > last) || (last >= max))
+        {
+            return -1;
+        }
+        while(first <= last)
+        {
+            *mask |= (uint64_t)1u << first++;
+        }
+
+        if(*end == '\0')
+        {
+            return 0;
+        }
+        if(*end != ',')
+        {
+            return -1;
+        }
+        text = end + 1;
+    }
+}
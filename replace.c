@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Files replaced whole by renaming a temporary file over them
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "replace.h"
+#ifdef _WIN32
+#   include <io.h>
+#   include <windows.h>
+#else
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* suffix of the temporary file, replaced by a unique name */
+#define REPLACE_SUFFIX      ".XXXXXX"
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Creates and opens the temporary file of the unique name made of the
+ * template. Returns NULL and sets errno on failure.
+ *****************************************************************************/
+static FILE *create_temporary(char *template)
+{
+#ifndef _WIN32
+    mode_t mask;
+    FILE *fp;
+    int fd;
+
+    fd = mkstemp(template);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    /* mkstemp() creates the file for the owner only, the file replaced by it
+       gets the permissions of a file created by fopen() */
+    mask = umask(0);
+    umask(mask);
+    fchmod(fd, 0666 & ~mask);
+    fp = fdopen(fd, "wb");
+    if(fp == NULL)
+    {
+        int error = errno;
+
+        close(fd);
+        remove(template);
+        errno = error;
+    }
+
+    return fp;
+#else
+    if(_mktemp_s(template, strlen(template) + 1u) != 0)
+    {
+        errno = EEXIST;
+        return NULL;
+    }
+
+    return fopen(template, "wb");
+#endif
+}
+
+/**************************************************************************//**
+ * Renames the temporary file over the target, also over an existing one on
+ * Windows where rename() refuses that. Returns -1 and sets errno on failure.
+ *****************************************************************************/
+static int rename_over(const char *tmp_path, const char *path)
+{
+#ifndef _WIN32
+    return rename(tmp_path, path);
+#else
+    if(!MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        errno = EACCES;
+        return -1;
+    }
+
+    return 0;
+#endif
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Creates a temporary file of a unique name in the directory of path, to be
+ * written in place of that file. The name of the temporary file is returned
+ * in tmp_path for replace_close(). Returns NULL and sets errno on failure.
+ *****************************************************************************/
+FILE *replace_open(const char *path, char **tmp_path)
+{
+    FILE *fp;
+
+    *tmp_path = malloc(strlen(path) + sizeof(REPLACE_SUFFIX));
+    if(*tmp_path == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    strcpy(*tmp_path, path);
+    strcat(*tmp_path, REPLACE_SUFFIX);
+
+    fp = create_temporary(*tmp_path);
+    if(fp == NULL)
+    {
+        free(*tmp_path);
+        *tmp_path = NULL;
+    }
+
+    return fp;
+}
+
+/**************************************************************************//**
+ * Closes the file opened by replace_open() and, if r is 0 and it has been
+ * written whole, renames it over path. Otherwise it is removed. Returns -1
+ * and sets errno if the file has not replaced path.
+ *****************************************************************************/
+int replace_close(FILE *fp, const char *path, char *tmp_path, int r)
+{
+    int error = errno;
+
+    if(fclose(fp) != 0)
+    {
+        error = errno;
+        r = -1;
+    }
+    if((r == 0) && (rename_over(tmp_path, path) != 0))
+    {
+        error = errno;
+        r = -1;
+    }
+    if(r != 0)
+    {
+        remove(tmp_path);
+        errno = error;
+    }
+    free(tmp_path);
+
+    return r;
+}
@@ -0,0 +1,510 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Server decoding the dumps sent over a Unix domain socket
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mfd.h"
+#include "serve.h"
+#ifdef __linux__
+#   include <fcntl.h>
+#   include <pthread.h>
+#   include <sys/epoll.h>
+#   include <sys/socket.h>
+#   include <sys/stat.h>
+#   include <sys/un.h>
+#   include <unistd.h>
+#endif
+
+#ifdef __linux__
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* longest payload of a request, a dump or a path */
+#define SERVE_PAYLOAD_MAX   MFD_MAX_DUMP_SIZE
+#define SERVE_BACKLOG       128
+#define SERVE_READ_SIZE     (2u * (SERVE_HEADER_SIZE + SERVE_PAYLOAD_MAX))
+
+/**************************************************************************//**
+ *                              PRIVATE TYPES
+ *****************************************************************************/
+/* state of one client, handled by one worker at a time */
+struct connection
+{
+    int fd;
+    unsigned char *in;          /* received bytes of unanswered requests */
+    size_t in_len;
+    struct output out;          /* replies not sent yet */
+    size_t sent;
+    bool closing;               /* no more requests are read */
+};
+
+struct server
+{
+    int epoll_fd;
+    int listen_fd;
+    serve_handler handler;
+};
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Reads a little endian 32 bit number.
+ *****************************************************************************/
+static uint32_t read_le32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+/**************************************************************************//**
+ * Switches the descriptor to the non blocking mode.
+ *****************************************************************************/
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+
+    return ((flags < 0) ||
+            (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)) ? -1 : 0;
+}
+
+/**************************************************************************//**
+ * Registers the connection again after it has been handled, for reading or,
+ * with replies still pending, for writing.
+ *****************************************************************************/
+static int rearm(const struct server *server, struct connection *conn)
+{
+    struct epoll_event ev;
+
+    ev.events = EPOLLONESHOT |
+                ((conn->sent < conn->out.len) ? EPOLLOUT : EPOLLIN);
+    ev.data.ptr = conn;
+
+    return epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+/**************************************************************************//**
+ * Closes the connection and releases its buffers.
+ *****************************************************************************/
+static void close_connection(const struct server *server,
+                             struct connection *conn)
+{
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn->in);
+    free(conn->out.data);
+    free(conn);
+}
+
+/**************************************************************************//**
+ * Accepts all the waiting clients and registers the listening socket again.
+ * Every connection is registered by EPOLLONESHOT, so only one worker handles
+ * it at a time and its requests are answered in order.
+ *****************************************************************************/
+static void accept_clients(const struct server *server)
+{
+    for(;;)
+    {
+        struct epoll_event ev;
+        struct connection *conn;
+        int fd = accept(server->listen_fd, NULL, NULL);
+
+        if(fd < 0)
+        {
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            {
+                perror("accept");
+            }
+            ev.events = EPOLLIN | EPOLLONESHOT;
+            ev.data.ptr = NULL;
+            if(epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, server->listen_fd,
+                         &ev) != 0)
+            {
+                perror("epoll_ctl");
+            }
+            return;
+        }
+
+        conn = calloc(1, sizeof(*conn));
+        if(conn != NULL)
+        {
+            conn->in = malloc(SERVE_READ_SIZE);
+        }
+        if((conn == NULL) || (conn->in == NULL) || (set_nonblocking(fd) != 0))
+        {
+            if(conn != NULL)
+            {
+                free(conn->in);
+            }
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.ptr = conn;
+        if(epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            free(conn->in);
+            free(conn);
+            close(fd);
+        }
+    }
+}
+
+/**************************************************************************//**
+ * Appends a reply frame with the payload to the output of the connection.
+ *****************************************************************************/
+static int append_reply(struct connection *conn, unsigned status,
+                        const char *payload, size_t len)
+{
+    char *p = out_reserve(&conn->out, SERVE_HEADER_SIZE + len);
+
+    if(p == NULL)
+    {
+        return -1;
+    }
+    p[0] = (char)status;
+    p[1] = (char)(len & 0xffu);
+    p[2] = (char)((len >> 8) & 0xffu);
+    p[3] = (char)((len >> 16) & 0xffu);
+    p[4] = (char)((len >> 24) & 0xffu);
+    memcpy(&p[SERVE_HEADER_SIZE], payload, len);
+    conn->out.len += SERVE_HEADER_SIZE + len;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Answers all the complete requests received by the connection. The output
+ * buffers of the worker are reused by all the requests. A malformed request
+ * is answered by an error and the connection is closed after the replies.
+ *****************************************************************************/
+static int answer_requests(const struct server *server,
+                           struct connection *conn, struct output *out,
+                           struct output *err)
+{
+    size_t done = 0;
+    int r = 0;
+
+    while((r == 0) && !conn->closing &&
+          (conn->in_len - done >= SERVE_HEADER_SIZE))
+    {
+        unsigned char *frame = &conn->in[done];
+        uint32_t len = read_le32(&frame[1]);
+        unsigned char *payload = &frame[SERVE_HEADER_SIZE];
+
+        if(((frame[0] != SERVE_DUMP) && (frame[0] != SERVE_PATH)) ||
+           (len > SERVE_PAYLOAD_MAX) ||
+           ((frame[0] == SERVE_PATH) && (len == 0)))
+        {
+            static const char message[] = "Malformed request\n";
+
+            conn->closing = true;
+            r = append_reply(conn, SERVE_FAILED, message,
+                             sizeof(message) - 1u);
+            break;
+        }
+        if(conn->in_len - done < SERVE_HEADER_SIZE + len)
+        {
+            break;
+        }
+
+        out->len = 0;
+        err->len = 0;
+        if(frame[0] == SERVE_PATH)
+        {
+            char path[SERVE_PAYLOAD_MAX + 1u];
+
+            memcpy(path, payload, len);
+            path[len] = '\0';
+            r = server->handler(path, NULL, 0, out, err);
+        }
+        else
+        {
+            r = server->handler(NULL, payload, len, out, err);
+        }
+        r = (r == 0) ? append_reply(conn, SERVE_OK, out->data, out->len)
+                     : append_reply(conn, SERVE_FAILED, err->data, err->len);
+        done += SERVE_HEADER_SIZE + len;
+    }
+
+    memmove(conn->in, &conn->in[done], conn->in_len - done);
+    conn->in_len -= done;
+
+    return r;
+}
+
+/**************************************************************************//**
+ * Reads what the client has sent. Returns -1 when the client has closed the
+ * connection or it has failed.
+ *****************************************************************************/
+static int receive(struct connection *conn)
+{
+    while(conn->in_len < SERVE_READ_SIZE)
+    {
+        ssize_t n = read(conn->fd, &conn->in[conn->in_len],
+                         SERVE_READ_SIZE - conn->in_len);
+
+        if(n > 0)
+        {
+            conn->in_len += (size_t)n;
+        }
+        else if(n == 0)
+        {
+            return -1;
+        }
+        else if(errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+        }
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Sends as much of the pending replies as the socket takes. Returns -1 when
+ * the connection has failed.
+ *****************************************************************************/
+static int send_replies(struct connection *conn)
+{
+    while(conn->sent < conn->out.len)
+    {
+        ssize_t n = send(conn->fd, &conn->out.data[conn->sent],
+                         conn->out.len - conn->sent, MSG_NOSIGNAL);
+
+        if(n >= 0)
+        {
+            conn->sent += (size_t)n;
+        }
+        else if(errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+        }
+    }
+
+    conn->out.len = 0;
+    conn->sent = 0;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Worker thread. Waits for a ready connection on the epoll instance shared
+ * by all the workers, answers its requests and registers it again.
+ *****************************************************************************/
+static void *serve_worker(void *arg)
+{
+    const struct server *server = arg;
+    struct output out = { NULL, 0, 0 };
+    struct output err = { NULL, 0, 0 };
+
+    for(;;)
+    {
+        struct epoll_event ev;
+        struct connection *conn;
+        bool eof = false;
+        int n = epoll_wait(server->epoll_fd, &ev, 1, -1);
+
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+        if(n == 0)
+        {
+            continue;
+        }
+        if(ev.data.ptr == NULL)
+        {
+            accept_clients(server);
+            continue;
+        }
+
+        conn = ev.data.ptr;
+        if((ev.events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !conn->closing)
+        {
+            eof = (receive(conn) != 0);
+            if(answer_requests(server, conn, &out, &err) != 0)
+            {
+                /* out of memory, the client gets what has been rendered */
+                conn->closing = true;
+            }
+        }
+
+        if((send_replies(conn) != 0) ||
+           ((eof || conn->closing) && (conn->sent == conn->out.len)) ||
+           (rearm(server, conn) != 0))
+        {
+            close_connection(server, conn);
+        }
+    }
+
+    free(out.data);
+    free(err.data);
+
+    return NULL;
+}
+
+/**************************************************************************//**
+ * Creates the listening socket. A stale socket left by a previous server is
+ * replaced, any other file of the name is kept.
+ *****************************************************************************/
+static int listen_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    mode_t mask;
+    int fd;
+    int r;
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if((lstat(path, &st) == 0) && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    /* only the user running the server may connect, the workers are not
+       started yet so the mask of the process can be changed */
+    mask = umask(077);
+    r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if((r != 0) || (listen(fd, SERVE_BACKLOG) != 0) ||
+       (set_nonblocking(fd) != 0))
+    {
+        int e = errno;
+
+        close(fd);
+        errno = e;
+        return -1;
+    }
+
+    return fd;
+}
+#endif /* __linux__ */
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Listens on the Unix domain socket and answers the requests by the handler
+ * in the given number of worker threads, until a worker fails. Returns -1
+ * and sets errno if the server cannot be started; ENOSYS on the systems
+ * without epoll.
+ *****************************************************************************/
+int serve_run(const char *socket_path, unsigned threads, serve_handler handler)
+{
+#ifdef __linux__
+    struct server server;
+    struct epoll_event ev;
+    pthread_t *workers;
+    unsigned started;
+
+    server.handler = handler;
+    server.listen_fd = listen_socket(socket_path);
+    if(server.listen_fd < 0)
+    {
+        return -1;
+    }
+    server.epoll_fd = epoll_create1(0);
+    if(server.epoll_fd < 0)
+    {
+        close(server.listen_fd);
+        return -1;
+    }
+
+    /* the listening socket is told by the NULL pointer; it is registered by
+       EPOLLONESHOT as well, level triggered it would wake all the workers
+       waiting on the instance for a single accept to succeed */
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = NULL;
+    if(epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &ev) != 0)
+    {
+        close(server.epoll_fd);
+        close(server.listen_fd);
+        return -1;
+    }
+
+    /* this thread is one of the workers */
+    workers = calloc(threads, sizeof(*workers));
+    for(started = 0; (workers != NULL) && (started + 1u < threads); started++)
+    {
+        if(pthread_create(&workers[started], NULL, serve_worker, &server) != 0)
+        {
+            break;
+        }
+    }
+    serve_worker(&server);
+    while(started > 0)
+    {
+        pthread_join(workers[--started], NULL);
+    }
+    free(workers);
+
+    close(server.epoll_fd);
+    close(server.listen_fd);
+    unlink(socket_path);
+
+    return 0;
+#else
+    (void)socket_path;
+    (void)threads;
+    (void)handler;
+    errno = ENOSYS;
+
+    return -1;
+#endif
+}
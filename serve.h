@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Server decoding the dumps sent over a Unix domain socket, so a gateway
+ * calling the parser for every card tap saves the start of a process. The
+ * connections are multiplexed by epoll among a fixed set of worker threads,
+ * every worker reuses its output buffers for all the requests. Linux only.
+ *
+ * Every request and reply is a frame of a 5 byte header and a payload:
+ *     request: type 'D' (the dump) or 'P' (path of a dump file), the length
+ *              of the payload as 4 bytes little endian, the payload
+ *     reply:   status 0 (decoded) or 1 (failed), the length of the payload
+ *              as 4 bytes little endian, the output or the error message
+ * The requests of one connection are answered in order. The socket is
+ * accessible to the user running the server only. The paths are checked by
+ * the handler.
+ *****************************************************************************/
+#ifndef SERVE_H
+#define SERVE_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stddef.h>
+#include "format.h"
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+#define SERVE_DUMP          'D'
+#define SERVE_PATH          'P'
+
+#define SERVE_OK            0u
+#define SERVE_FAILED        1u
+
+#define SERVE_HEADER_SIZE   5u
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* Decodes one request, the dump of size bytes or the NUL terminated path
+   when data is NULL, to out or to err. Returns 0 on success. Called by more
+   worker threads at once. */
+typedef int (*serve_handler)(const char *path, const unsigned char *data,
+                             size_t size, struct output *out,
+                             struct output *err);
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int serve_run(const char *socket_path, unsigned threads,
+              serve_handler handler);
+
+#endif /* SERVE_H */
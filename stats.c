@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Timings of the processing stages
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+/**************************************************************************//**
+ *                          PRIVATE VARIABLES
+ *****************************************************************************/
+static const char * const stage_names[STAGE_COUNT] =
+{
+    "read", "detect", "decode", "format", "write"
+};
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Returns the histogram bucket of the time. Times below HIST_SUB ns have a
+ * bucket each, the longer ones are split by the highest bit and the
+ * HIST_SUB_BITS bits following it.
+ *****************************************************************************/
+static unsigned bucket_of(uint64_t ns)
+{
+    unsigned e = 0;
+    uint64_t v = ns;
+
+    if(ns < HIST_SUB)
+    {
+        return (unsigned)ns;
+    }
+    while(v >= HIST_SUB * 2u)
+    {
+        v >>= 1;
+        e++;
+    }
+
+    /* v is HIST_SUB to 2 * HIST_SUB - 1 now */
+    return (e + 1u) * HIST_SUB + (unsigned)(v - HIST_SUB);
+}
+
+/**************************************************************************//**
+ * Returns the shortest time falling to the bucket.
+ *****************************************************************************/
+static uint64_t bucket_start(unsigned bucket)
+{
+    unsigned e = bucket / HIST_SUB;
+
+    if(e == 0)
+    {
+        return bucket;
+    }
+
+    return (uint64_t)(HIST_SUB + bucket % HIST_SUB) << (e - 1u);
+}
+
+/**************************************************************************//**
+ * Returns the time not exceeded by the share of the samples, e.g. 0.99.
+ *****************************************************************************/
+static uint64_t percentile(const struct histogram *h, double share)
+{
+    uint64_t rank = (uint64_t)(share * (double)h->count);
+    uint64_t seen = 0;
+    unsigned i;
+
+    for(i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->bucket[i];
+        if(seen > rank)
+        {
+            return bucket_start(i);
+        }
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Returns the monotonic time in ns.
+ *****************************************************************************/
+uint64_t stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**************************************************************************//**
+ * Clears the counters and starts the time of the run.
+ *****************************************************************************/
+void stats_init(struct run_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_init(&stats->lock, NULL);
+    stats->start_ns = stats_now();
+}
+
+/**************************************************************************//**
+ * Releases the lock of the counters.
+ *****************************************************************************/
+void stats_free(struct run_stats *stats)
+{
+    pthread_mutex_destroy(&stats->lock);
+}
+
+/**************************************************************************//**
+ * Adds the time of one stage of one dump.
+ *****************************************************************************/
+void stats_add(struct run_stats *stats, unsigned stage, uint64_t ns)
+{
+    struct histogram *h = &stats->stage[stage];
+
+    pthread_mutex_lock(&stats->lock);
+    h->count++;
+    h->total_ns += ns;
+    h->bucket[bucket_of(ns)]++;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+/**************************************************************************//**
+ * Counts a decoded dump.
+ *****************************************************************************/
+void stats_add_dump(struct run_stats *stats, size_t bytes,
+                    unsigned invalid_trailers)
+{
+    pthread_mutex_lock(&stats->lock);
+    stats->dumps++;
+    stats->bytes += bytes;
+    stats->invalid_trailers += invalid_trailers;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+/**************************************************************************//**
+ * Writes the totals of the stages and the throughput of the run, with
+ * verbose > 1 also the median and the 99th percentile of every stage.
+ *****************************************************************************/
+void stats_report(struct run_stats *stats, FILE *fp, int verbose)
+{
+    double wall = (double)(stats_now() - stats->start_ns) * 1e-9;
+    uint64_t busy = 0;
+    unsigned i;
+
+    pthread_mutex_lock(&stats->lock);
+    for(i = 0; i < STAGE_COUNT; i++)
+    {
+        busy += stats->stage[i].total_ns;
+    }
+
+    fprintf(fp, "Stage     count     total s  share%s\n",
+            (verbose > 1) ? "     p50 us     p99 us" : "");
+    for(i = 0; i < STAGE_COUNT; i++)
+    {
+        const struct histogram *h = &stats->stage[i];
+
+        fprintf(fp, "%-8s %6lu %11.6f %5.1f%%", stage_names[i],
+                (unsigned long)h->count, (double)h->total_ns * 1e-9,
+                busy ? 100.0 * (double)h->total_ns / (double)busy : 0.0);
+        if(verbose > 1)
+        {
+            fprintf(fp, " %10.3f %10.3f",
+                    (double)percentile(h, 0.50) * 1e-3,
+                    (double)percentile(h, 0.99) * 1e-3);
+        }
+        fprintf(fp, "\n");
+    }
+
+    if(wall <= 0)
+    {
+        wall = 1e-9;
+    }
+    fprintf(fp, "%lu dumps, %lu bytes in %.3f s: %.1f MB/s, %.0f dumps/s, "
+            "%lu invalid trailers\n", (unsigned long)stats->dumps,
+            (unsigned long)stats->bytes, wall,
+            (double)stats->bytes / wall / 1e6, (double)stats->dumps / wall,
+            (unsigned long)stats->invalid_trailers);
+    pthread_mutex_unlock(&stats->lock);
+}
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Timings of the processing stages of a run reported by -v. Every stage
+ * keeps its total time and a histogram of the times per dump, so a run of
+ * any length needs the same memory and the percentiles can still be shown.
+ *****************************************************************************/
+#ifndef STATS_H
+#define STATS_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+#define STAGE_READ          0
+#define STAGE_DETECT        1
+#define STAGE_DECODE        2
+#define STAGE_FORMAT        3
+#define STAGE_WRITE         4
+#define STAGE_COUNT         5
+
+/* times of 2^e to 2^(e+1) ns are split to HIST_SUB buckets */
+#define HIST_SUB_BITS       4u
+#define HIST_SUB            (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS        ((64u - HIST_SUB_BITS + 1u) * HIST_SUB)
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* times of one stage */
+struct histogram
+{
+    uint64_t count;
+    uint64_t total_ns;
+    uint32_t bucket[HIST_BUCKETS];
+};
+
+/* counters of the whole run, shared by the worker threads */
+struct run_stats
+{
+    struct histogram stage[STAGE_COUNT];
+    uint64_t dumps;
+    uint64_t bytes;
+    uint64_t invalid_trailers;
+    uint64_t start_ns;
+    pthread_mutex_t lock;
+};
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+uint64_t stats_now(void);
+void stats_init(struct run_stats *stats);
+void stats_free(struct run_stats *stats);
+void stats_add(struct run_stats *stats, unsigned stage, uint64_t ns);
+void stats_add_dump(struct run_stats *stats, size_t bytes,
+                    unsigned invalid_trailers);
+void stats_report(struct run_stats *stats, FILE *fp, int verbose);
+
+#endif /* STATS_H */
@@ -0,0 +1,527 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Reader of many small files by io_uring
+ *
+ * The ring is set up by the raw system calls, no library is needed. Every file
+ * takes a slot of a window of depth files: its open is submitted, the size of
+ * the opened file decides how much of it is read and the close follows the
+ * read without being waited for. The files are handed over in the order of the
+ * list as soon as the first one of the window is read.
+ *****************************************************************************/
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uring.h"
+#if defined(__linux__) && defined(HAVE_IO_URING)
+#   include <fcntl.h>
+#   include <linux/io_uring.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+/**************************************************************************//**
+ *                                 DEFINES
+ *****************************************************************************/
+/* operations in the user data of the requests, the slot is in the rest */
+#define OP_OPEN             0u
+#define OP_READ             1u
+#define OP_CLOSE            2u
+#define OP_BITS             2u
+
+/**************************************************************************//**
+ *                              PRIVATE TYPES
+ *****************************************************************************/
+/* the rings shared with the kernel */
+struct ring
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    void *cq_map;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+    unsigned sq_next;           /* tail after the queued requests */
+    unsigned to_submit;
+    unsigned pending;           /* submitted requests not completed yet */
+};
+
+/* one file of the window */
+struct slot
+{
+    unsigned char *window;      /* the part of the window of the slot */
+    unsigned char *heap;        /* buffer of the files longer than the part */
+    size_t heap_size;
+    unsigned char *buffer;      /* one of the two above */
+    size_t len;                 /* bytes read so far */
+    uint64_t size;
+    int fd;
+    int error;
+    bool done;
+};
+
+/**************************************************************************//**
+ *                          PRIVATE FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Sets up the ring for the number of requests. Returns -1 and sets errno if
+ * the kernel has no io_uring or it is not allowed.
+ *****************************************************************************/
+static int ring_setup(struct ring *ring, unsigned entries)
+{
+    struct io_uring_params p;
+    char *sq;
+    char *cq;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if(ring->fd < 0)
+    {
+        return -1;
+    }
+
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(ring->cq_size > ring->sq_size)
+        {
+            ring->sq_size = ring->cq_size;
+        }
+        ring->cq_size = ring->sq_size;
+    }
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_map = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_map = (p.features & IORING_FEAT_SINGLE_MMAP) ? ring->sq_map :
+                   mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if((ring->sq_map == MAP_FAILED) || (ring->cq_map == MAP_FAILED) ||
+       (ring->sqes == MAP_FAILED))
+    {
+        int e = errno;
+
+        if(ring->sqes != MAP_FAILED)
+        {
+            munmap(ring->sqes, ring->sqes_size);
+        }
+        if((ring->cq_map != MAP_FAILED) && (ring->cq_map != ring->sq_map))
+        {
+            munmap(ring->cq_map, ring->cq_size);
+        }
+        if(ring->sq_map != MAP_FAILED)
+        {
+            munmap(ring->sq_map, ring->sq_size);
+        }
+        close(ring->fd);
+        errno = e;
+        return -1;
+    }
+
+    sq = ring->sq_map;
+    cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring->sq_next = *ring->sq_tail;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Releases the ring.
+ *****************************************************************************/
+static void ring_free(struct ring *ring)
+{
+    munmap(ring->sqes, ring->sqes_size);
+    if(ring->cq_map != ring->sq_map)
+    {
+        munmap(ring->cq_map, ring->cq_size);
+    }
+    munmap(ring->sq_map, ring->sq_size);
+    close(ring->fd);
+}
+
+/**************************************************************************//**
+ * Queues a request of the operation on the slot. The ring has room for all
+ * the requests the window can have in flight.
+ *****************************************************************************/
+static struct io_uring_sqe *ring_request(struct ring *ring, unsigned op,
+                                         size_t slot)
+{
+    unsigned index = ring->sq_next++ & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = ((uint64_t)slot << OP_BITS) | op;
+    ring->sq_array[index] = index;
+    ring->to_submit++;
+    ring->pending++;
+
+    return sqe;
+}
+
+/**************************************************************************//**
+ * Publishes the queued requests to the kernel. The tail is released after the
+ * requests have been filled in.
+ *****************************************************************************/
+static void ring_publish(struct ring *ring)
+{
+    __atomic_store_n(ring->sq_tail, ring->sq_next, __ATOMIC_RELEASE);
+}
+
+/**************************************************************************//**
+ * Submits the queued requests and waits for at least one completion.
+ *****************************************************************************/
+static int ring_enter(struct ring *ring)
+{
+    for(;;)
+    {
+        long r = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 1u,
+                         IORING_ENTER_GETEVENTS, NULL, 0);
+
+        if(r >= 0)
+        {
+            ring->to_submit -= (unsigned)r;
+            return 0;
+        }
+        if(errno != EINTR)
+        {
+            return -1;
+        }
+    }
+}
+
+/**************************************************************************//**
+ * Queues the open of the file.
+ *****************************************************************************/
+static void queue_open(struct ring *ring, size_t slot, const char *path)
+{
+    struct io_uring_sqe *sqe = ring_request(ring, OP_OPEN, slot);
+
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    ring_publish(ring);
+}
+
+/**************************************************************************//**
+ * Makes room for want bytes of the file in the buffer of the slot, keeping
+ * the bytes read so far. Returns -1 if out of memory.
+ *****************************************************************************/
+static int slot_reserve(struct slot *s, size_t limit, size_t want)
+{
+    if(want <= ((s->buffer == s->heap) ? s->heap_size : limit))
+    {
+        return 0;
+    }
+    if(s->heap_size < want)
+    {
+        unsigned char *heap = malloc(want);
+
+        if(heap == NULL)
+        {
+            return -1;
+        }
+        memcpy(heap, s->buffer, s->len);
+        free(s->heap);
+        s->heap = heap;
+        s->heap_size = want;
+    }
+    else
+    {
+        memcpy(s->heap, s->buffer, s->len);
+    }
+    s->buffer = s->heap;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Queues the close of the file of the slot, which is then handed over.
+ *****************************************************************************/
+static void slot_finish(struct ring *ring, struct slot *s, size_t slot)
+{
+    struct io_uring_sqe *sqe = ring_request(ring, OP_CLOSE, slot);
+
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = s->fd;
+    s->done = true;
+}
+
+/**************************************************************************//**
+ * Handles the completed requests: takes the size of the opened files, reads
+ * as much of them as the sizer wants and closes them. When stopping, the
+ * opened files are just closed.
+ *****************************************************************************/
+static void reap(struct ring *ring, struct slot *slots, size_t limit,
+                 uring_sizer sizer, void *ctx, bool stopping)
+{
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned queued = 0;
+
+    while(head != tail)
+    {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        size_t index = (size_t)(cqe->user_data >> OP_BITS);
+        unsigned op = (unsigned)(cqe->user_data & ((1u << OP_BITS) - 1u));
+        struct slot *s = &slots[index];
+        int res = cqe->res;
+        struct io_uring_sqe *sqe;
+        size_t want;
+
+        head++;
+        ring->pending--;
+
+        if(op == OP_CLOSE)
+        {
+            continue;
+        }
+        if(op == OP_OPEN)
+        {
+            struct stat st;
+
+            if((res < 0) || stopping)
+            {
+                if(res >= 0)
+                {
+                    close(res);
+                }
+                s->error = (res < 0) ? -res : 0;
+                s->done = true;
+                continue;
+            }
+            s->fd = res;
+            /* the inode has just been looked up by the open, its size is
+               taken without waiting */
+            if(fstat(res, &st) != 0)
+            {
+                s->error = errno;
+            }
+            else if(!S_ISREG(st.st_mode))
+            {
+                s->error = ESPIPE;
+            }
+            s->size = (uint64_t)st.st_size;
+        }
+        else if(res < 0)
+        {
+            s->error = -res;
+        }
+        else
+        {
+            s->len += (size_t)res;
+        }
+
+        want = 0;
+        /* nothing more is read past the end of a file shrunk since the open */
+        if((s->error == 0) && !stopping && ((op == OP_OPEN) || (res > 0)))
+        {
+            want = sizer(ctx, s->size, (s->len > 0) ? s->buffer : NULL,
+                         s->len);
+            if((want > s->len) && (slot_reserve(s, limit, want) != 0))
+            {
+                s->error = ENOMEM;
+            }
+        }
+        queued++;
+        if((s->error != 0) || (want <= s->len))
+        {
+            slot_finish(ring, s, index);
+            continue;
+        }
+        sqe = ring_request(ring, OP_READ, index);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = s->fd;
+        sqe->addr = (uint64_t)(uintptr_t)&s->buffer[s->len];
+        sqe->len = (unsigned)(want - s->len);
+        sqe->off = s->len;
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    if(queued > 0)
+    {
+        ring_publish(ring);
+    }
+}
+#endif /* __linux__ && HAVE_IO_URING */
+
+/**************************************************************************//**
+ *                          PUBLIC FUNCTIONS
+ *****************************************************************************/
+/**************************************************************************//**
+ * Reads the files of the list, as many bytes of each as the sizer wants,
+ * keeping up to depth files in flight, and hands them to the callback in the
+ * order of the list. The files are read to limit bytes of the window each,
+ * longer ones to a buffer of their own. The number of the files handed over is
+ * returned in done. Returns -1 and sets errno if the ring fails, ENOSYS if
+ * there is no io_uring; the rest of the files is then to be read another way.
+ *****************************************************************************/
+int uring_read_files(const char *const *paths, size_t count, unsigned depth,
+                     size_t limit, uring_sizer sizer, uring_callback callback,
+                     void *ctx, size_t *done)
+{
+#if defined(__linux__) && defined(HAVE_IO_URING)
+    struct ring ring;
+    struct slot *slots;
+    unsigned char *buffers;
+    size_t head = 0;
+    size_t next = 0;
+    size_t i;
+    bool stopping = false;
+    int r = 0;
+
+    *done = 0;
+    slots = calloc(depth, sizeof(*slots));
+    buffers = malloc(depth * limit);
+    if((slots == NULL) || (buffers == NULL))
+    {
+        free(slots);
+        free(buffers);
+        errno = ENOMEM;
+        return -1;
+    }
+    for(i = 0; i < depth; i++)
+    {
+        slots[i].window = &buffers[i * limit];
+    }
+
+    /* every slot has at most a close of its previous file and an open or a
+       read of its current one in flight */
+    if(ring_setup(&ring, 2u * depth) != 0)
+    {
+        free(slots);
+        free(buffers);
+        return -1;
+    }
+
+    while(!stopping && (head < count))
+    {
+        while((next < count) && (next - head < depth))
+        {
+            struct slot *s = &slots[next % depth];
+
+            s->buffer = s->window;
+            s->len = 0;
+            s->size = 0;
+            s->done = false;
+            s->error = 0;
+            queue_open(&ring, next % depth, paths[next]);
+            next++;
+        }
+
+        if(!slots[head % depth].done)
+        {
+            if(ring_enter(&ring) != 0)
+            {
+                r = -1;
+                break;
+            }
+            reap(&ring, slots, limit, sizer, ctx, false);
+        }
+
+        while((head < next) && slots[head % depth].done)
+        {
+            const struct slot *s = &slots[head % depth];
+
+            stopping = (callback(ctx, head, s->buffer, s->len, s->size,
+                                 s->error) != 0);
+            *done = ++head;
+            if(stopping)
+            {
+                break;
+            }
+        }
+    }
+
+    /* the requests still in flight refer to the buffers */
+    if(r == 0)
+    {
+        int e = 0;
+
+        while(ring.pending > 0)
+        {
+            if(ring_enter(&ring) != 0)
+            {
+                e = errno;
+                break;
+            }
+            reap(&ring, slots, limit, sizer, ctx, true);
+        }
+        errno = e;
+        r = (e == 0) ? 0 : -1;
+    }
+
+    ring_free(&ring);
+    if(ring.pending == 0)
+    {
+        for(i = 0; i < depth; i++)
+        {
+            free(slots[i].heap);
+        }
+        free(buffers);
+    }
+    free(slots);
+    /* else the kernel may still write to the buffers of the cancelled reads,
+       so they are left allocated */
+
+    return r;
+#else
+    (void)paths;
+    (void)count;
+    (void)depth;
+    (void)limit;
+    (void)sizer;
+    (void)callback;
+    (void)ctx;
+    *done = 0;
+    errno = ENOSYS;
+
+    return -1;
+#endif
+}
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: 0BSD */
+/* Copyright (C) 2024 Petr Pazourek
+ * Copyright (C) 2014-2024 Pavel Zhovner <pavel@zhovner.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION
+ * OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**************************************************************************//**
+ * Reader of many small files by io_uring. Scans of big sets of dumps on a
+ * cold cache are bound by the latency of the opens and reads, the ring keeps
+ * hundreds of them in flight. Linux only, elsewhere and on kernels without
+ * io_uring the files are to be read the blocking way.
+ *****************************************************************************/
+#ifndef URING_H
+#define URING_H
+
+/**************************************************************************//**
+ * INCLUDE FILES: Header files of modules referenced by this module
+ *****************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+/**************************************************************************//**
+ *                              PUBLIC TYPES
+ *****************************************************************************/
+/* Gets the size of a regular file being read and the first len bytes of it
+   read to data so far, none before the first read. Returns the number of
+   bytes of the file to be read, the file is handed over once no more of
+   them are wanted. */
+typedef size_t (*uring_sizer)(void *ctx, uint64_t size,
+                              const unsigned char *data, size_t len);
+
+/* Gets the file of the given index of the list of size bytes, read to data
+   of len bytes, or the errno of the failed open or read; other files than
+   the regular ones are not read and give ESPIPE. Returns non zero to stop. */
+typedef int (*uring_callback)(void *ctx, size_t index,
+                              const unsigned char *data, size_t len,
+                              uint64_t size, int error);
+
+/**************************************************************************//**
+ *                        PROTOTYPES OF PUBLIC FUNCTIONS
+ *****************************************************************************/
+int uring_read_files(const char *const *paths, size_t count, unsigned depth,
+                     size_t limit, uring_sizer sizer, uring_callback callback,
+                     void *ctx, size_t *done);
+
+#endif /* URING_H */
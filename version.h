@@ -3,6 +3,6 @@
 
 /* Standard Version Type */
 static const long MAJOR  = 1;
-static const long MINOR  = 0;
+static const long MINOR  = 1;
 
 #endif /* VERSION_H */